@@ -20,7 +20,7 @@ fi
 echo -en "\e[0m"
 
 
-CFLAGS="-std=c23 -Wall -Werror"
+CFLAGS="-std=c23 -Wall -Werror -D_GNU_SOURCE"
 RELEASE="target/release"
 DEBUG="target/debug"
 
@@ -22,6 +22,10 @@ void *arena_alloc(Arena *arena, uint64_t size)
   -- Returns required size of memory from the arena to use.
       Returns NULL if the requested size is more than its capacity.
 
+void *arena_alloc_aligned(Arena *arena, uint64_t size, uint64_t align)
+  -- Same as arena_alloc(), but the returned address is a multiple of
+      `align`, which must be a power of two.
+
 void arena_visualize(const Arena *arena)
   -- To get an overview of the arena.
 
@@ -39,6 +43,9 @@ Reference materials: https://m.youtube.com/watch?v=ZisNZcQn6fo&pp=ygULYXJlbmEgYW
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "trace.c"
 
 #include "err.c"
 _Thread_local char arena_err[ERR_BUF_SIZE];
@@ -53,6 +60,7 @@ typedef struct Arena {
 // initializes the arena chunk with a capacity of 
 // ARENA_[8,16,32,..,2048] or any custom integer greater than 0.
 Arena *arena_init(uint64_t capacity) {
+    TRACE_LIB_FUNC();
     if (capacity <= 0)
       return_halt(arena_err, NULL, "Capacity of arena must be greater than 0.");
 
@@ -74,6 +82,7 @@ Arena *arena_init(uint64_t capacity) {
 // Returns required size of memory from the arena to use.
 // Returns NULL if the requested size is more than its capacity.
 void *arena_alloc(Arena *arena, uint64_t size) {
+  TRACE_LIB_FUNC();
   if (size > arena->capacity)
     return_bad(arena_err, NULL, "The requested size must be less than or equal to arena capacity");
 
@@ -94,6 +103,32 @@ void *arena_alloc(Arena *arena, uint64_t size) {
   return_ok(arena_err, mem_buf);
 }
 
+// Same as arena_alloc(), but the returned address is a multiple of `align`.
+// `align` must be a power of two. Returns NULL if the requested size
+// (plus padding) is more than the arena's capacity.
+void *arena_alloc_aligned(Arena *arena, uint64_t size, uint64_t align) {
+  TRACE_LIB_FUNC();
+  if (align == 0 || (align & (align - 1)) != 0)
+    return_bad(arena_err, NULL, "The alignment must be a power of two");
+  if (size + align - 1 > arena->capacity)
+    return_bad(arena_err, NULL, "The requested size must be less than or equal to arena capacity");
+
+  Arena *current = arena;
+  uint64_t padding;
+  while(true) {
+    // bytes to skip so that the next unused address is aligned.
+    padding = -(uintptr_t)(current->arena_buf + current->buf_size) & (align - 1);
+    if (current->buf_size + padding + size <= current->capacity) break;
+    if(current->next_arena == NULL) {
+      current->next_arena = arena_init(current->capacity);
+    }
+    current = current->next_arena;
+  }
+  void *mem_buf = current->arena_buf + current->buf_size + padding;
+  current->buf_size += padding + size;
+  return_ok(arena_err, mem_buf);
+}
+
 // To get an overview of the arena.
 void arena_visualize(const Arena *arena) {
   const Arena *current = arena;
@@ -119,6 +154,7 @@ void arena_reset(Arena *arena) {
 
 // Deallocates the entire arena.
 void arena_free(Arena *arena) {
+  TRACE_LIB_FUNC();
   Arena *current = arena;
   Arena *next;
   while(current != NULL) {
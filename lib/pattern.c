@@ -0,0 +1,858 @@
+/*
+ * Compiled patterns for the String type.
+ *
+ * Globs and a small regex subset are compiled once into a pair of DFAs
+ * stored in an Arena, and can then be matched against any number of
+ * strings in linear time. There is no backtracking, so no pattern can
+ * blow up on a bad input.
+ *
+ * Supported regex syntax:
+ *   literals, .  [abc] [a-z] [^...]  \d \D \w \W \s \S \n \t \r \f \v \\ ...
+ *   (...)  a|b  *  +  ?  {m}  {m,}  {m,n}
+ *   ^ at the start and $ at the end of the pattern (they anchor the whole pattern).
+ * `.` matches any byte except '\n'. Patterns work on bytes, not codepoints.
+ *
+ * Supported glob syntax:
+ *   *   any run of bytes except '/'
+ *   **  any run of bytes, including '/'
+ *   ?   a single byte except '/'
+ *   [abc] [a-z] [!...]  {a,b,c}  \x
+ * Globs always have to match the whole string.
+ *
+ * Searching returns leftmost-longest matches. The forward DFA answers
+ * pattern_match() and the longest end of a match. A search first scans
+ * forward, starting a new match attempt at every byte, up to the first
+ * position where some match ends. A DFA of the reversed pattern is then
+ * scanned back from there to the leftmost start of those matches. Matches
+ * that start even earlier must still be running at that point, so the
+ * forward scan is repeated without new attempts past that start until they
+ * all die, and the reversed DFA is run once more from the last end they
+ * reach. A search therefore only reads the string up to the end of the
+ * matches around its result, instead of up to the end of the string.
+ * The scan needs extra DFA states; patterns for which they don't fit in
+ * PATTERN_MAX_STATES, and anchored patterns, scan the reversed DFA back
+ * from the end of the string instead.
+ *
+ * Date: October-19-2026
+ *
+ * ## HOW TO USE ##
+ * Pattern *pattern_compile(Arena *arena, const char *regex, uint64_t len)
+ * Pattern *pattern_glob(Arena *arena, const char *glob, uint64_t len)
+ *   -- Compiles a pattern into `arena`. Returns NULL on syntax errors, if
+ *      it nests deeper than PATTERN_MAX_DEPTH or if it needs more than
+ *      PATTERN_MAX_STATES DFA states.
+ *
+ * bool pattern_match(const Pattern *p, const String *s)
+ *   -- true if the whole of `s` matches.
+ *
+ * int64_t pattern_search(const Pattern *p, const String *s, uint64_t start)
+ *   -- Index of the leftmost match at or after `start`, BAD if none.
+ *
+ * String pattern_capture(const Pattern *p, const String *s, uint64_t start)
+ *   -- Slice of the leftmost-longest match at or after `start`,
+ *      STR_EMPTY if none.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "strings.c"
+#include "arena.c"
+
+#include "err.c"
+_Thread_local signed char pattern_err[ERR_BUF_SIZE];
+
+#ifndef PATTERN_MAX_STATES
+#define PATTERN_MAX_STATES 4096 // upper bound on the states of each DFA
+#endif
+#define PATTERN_MAX_REPEAT 1000 // upper bound on {m,n} counts
+#define PATTERN_MAX_DEPTH 500   // upper bound on the nesting of groups, braces and repetitions
+
+typedef struct {
+  uint8_t classes[256]; // byte -> equivalence class. bytes of a class behave the same.
+  uint32_t n_classes;
+  uint32_t fwd_states;
+  uint32_t rev_states;
+  int32_t* fwd;         // forward DFA [state * n_classes + class], -1 is the dead state
+  int32_t* fwd_scan;    // same states, but a new match attempt starts after every byte. may be NULL
+  uint8_t* fwd_accept;
+  int32_t* rev;         // DFA of the reversed pattern, unanchored unless anchor_end
+  uint8_t* rev_accept;
+  bool anchor_start;
+  bool anchor_end;
+} Pattern;
+
+/* ---------------- compiler internals ---------------- */
+
+typedef struct { uint64_t bits[4]; } _PatSet; // set of bytes
+
+enum { _PAT_SET, _PAT_CAT, _PAT_ALT, _PAT_REP, _PAT_EMPTY }; // syntax tree nodes
+enum { _NFA_SET, _NFA_SPLIT, _NFA_MATCH };                   // NFA states
+
+typedef struct {
+  uint8_t type;
+  int32_t set;     // _PAT_SET: index into sets
+  int32_t child;   // first child of _PAT_CAT, _PAT_ALT and _PAT_REP
+  int32_t sibling; // next child of the parent
+  int32_t min, max; // bounds of _PAT_REP, max = -1 for unbounded
+  int32_t height;   // levels of nodes below this one
+} _PatNode;
+
+typedef struct {
+  uint8_t type;
+  int32_t set;
+  int32_t out1, out2;
+} _PatState;
+
+typedef struct {
+  const char* src;
+  uint64_t len, pos;
+  _PatNode* nodes;
+  int32_t n_nodes, cap_nodes;
+  _PatSet* sets;
+  int32_t n_sets, cap_sets;
+  _PatState* nfa;
+  int32_t n_nfa, cap_nfa;
+  const char* err; // first error. everything unwinds once it is set.
+} _PatCompiler;
+
+// grows a compiler array by one element. returns false on allocation failure.
+static bool _pat_grow(void** arr, int32_t* cap, int32_t n, size_t elem) {
+  if (n < *cap) return true;
+  int32_t new_cap = (*cap == 0) ? 16 : *cap * 2;
+  void* tmp = realloc(*arr, new_cap * elem);
+  if (tmp == NULL) return false;
+  *arr = tmp;
+  *cap = new_cap;
+  return true;
+}
+
+static int32_t _pat_fail(_PatCompiler* c, const char* err) {
+  if (c->err == NULL) c->err = err;
+  return -1;
+}
+
+static int32_t _pat_node(_PatCompiler* c, uint8_t type) {
+  if (!_pat_grow((void**)&c->nodes, &c->cap_nodes, c->n_nodes, sizeof(_PatNode)))
+    return _pat_fail(c, "failed to allocate memory for the pattern");
+  c->nodes[c->n_nodes] = (_PatNode) { .type = type, .set = -1, .child = -1, .sibling = -1 };
+  return c->n_nodes++;
+}
+
+static int32_t _pat_new_set(_PatCompiler* c) {
+  if (!_pat_grow((void**)&c->sets, &c->cap_sets, c->n_sets, sizeof(_PatSet)))
+    return _pat_fail(c, "failed to allocate memory for the pattern");
+  c->sets[c->n_sets] = (_PatSet) {0};
+  return c->n_sets++;
+}
+
+static inline void _pat_set_add(_PatSet* set, uint8_t ch) { set->bits[ch >> 6] |= 1ULL << (ch & 63); }
+static inline bool _pat_set_has(const _PatSet* set, uint8_t ch) { return (set->bits[ch >> 6] >> (ch & 63)) & 1; }
+
+static void _pat_set_range(_PatSet* set, uint8_t lo, uint8_t hi) {
+  for (int ch = lo; ch <= hi; ch++) _pat_set_add(set, ch);
+}
+
+static void _pat_set_invert(_PatSet* set) {
+  for (int i = 0; i < 4; i++) set->bits[i] = ~set->bits[i];
+}
+
+static void _pat_set_union(_PatSet* dest, const _PatSet* src) {
+  for (int i = 0; i < 4; i++) dest->bits[i] |= src->bits[i];
+}
+
+// a syntax node matching a single byte out of a fresh set. the set index is returned in *set.
+static int32_t _pat_set_node(_PatCompiler* c, int32_t* set) {
+  int32_t node = _pat_node(c, _PAT_SET);
+  *set = _pat_new_set(c);
+  if (node < 0 || *set < 0) return -1;
+  c->nodes[node].set = *set;
+  return node;
+}
+
+// the NFA is built recursively over the syntax tree, so its height is bounded.
+static int32_t _pat_nest(_PatCompiler* c, int32_t parent, int32_t child) {
+  if (c->nodes[child].height >= PATTERN_MAX_DEPTH) return _pat_fail(c, "pattern is nested too deeply");
+  if (c->nodes[parent].height <= c->nodes[child].height) c->nodes[parent].height = c->nodes[child].height + 1;
+  return parent;
+}
+
+static int32_t _pat_append(_PatCompiler* c, int32_t parent, int32_t* last, int32_t child) {
+  if (*last < 0) c->nodes[parent].child = child;
+  else c->nodes[*last].sibling = child;
+  *last = child;
+  return _pat_nest(c, parent, child);
+}
+
+// adds the bytes of the escape sequence at c->pos (after the '\') to `set`.
+static int32_t _pat_escape(_PatCompiler* c, _PatSet* set) {
+  if (c->pos >= c->len) return _pat_fail(c, "trailing backslash");
+  char e = c->src[c->pos++];
+  _PatSet class = {0};
+  switch (e) {
+    case 'd': case 'D':
+      _pat_set_range(&class, '0', '9');
+      break;
+    case 'w': case 'W':
+      _pat_set_range(&class, '0', '9');
+      _pat_set_range(&class, 'a', 'z');
+      _pat_set_range(&class, 'A', 'Z');
+      _pat_set_add(&class, '_');
+      break;
+    case 's': case 'S':
+      _pat_set_add(&class, ' ');
+      _pat_set_range(&class, '\t', '\r'); // \t \n \v \f \r
+      break;
+    case 'n': _pat_set_add(&class, '\n'); break;
+    case 't': _pat_set_add(&class, '\t'); break;
+    case 'r': _pat_set_add(&class, '\r'); break;
+    case 'f': _pat_set_add(&class, '\f'); break;
+    case 'v': _pat_set_add(&class, '\v'); break;
+    default:
+      if ((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || (e >= '0' && e <= '9'))
+        return _pat_fail(c, "unknown escape sequence");
+      _pat_set_add(&class, e);
+  }
+  if (e == 'D' || e == 'W' || e == 'S') _pat_set_invert(&class);
+  _pat_set_union(set, &class);
+  return 0;
+}
+
+// parses a [...] class. c->pos is after the '['. `negate_chars` are the
+// characters that negate the class when they come first ("^" or "!^").
+static int32_t _pat_class(_PatCompiler* c, const char* negate_chars) {
+  int32_t set;
+  int32_t node = _pat_set_node(c, &set);
+  if (node < 0) return -1;
+  _PatSet class = {0};
+  bool negate = c->pos < c->len && strchr(negate_chars, c->src[c->pos]) != NULL;
+  if (negate) c->pos++;
+  uint64_t first = c->pos;
+  while (true) {
+    if (c->pos >= c->len) return _pat_fail(c, "missing ] in character class");
+    char ch = c->src[c->pos++];
+    if (ch == ']' && c->pos - 1 != first) break;
+    if (ch == '\\') {
+      if (_pat_escape(c, &class) < 0) return -1;
+      continue;
+    }
+    if (c->pos + 1 < c->len && c->src[c->pos] == '-' && c->src[c->pos + 1] != ']') {
+      char hi = c->src[c->pos + 1];
+      if ((uint8_t)hi < (uint8_t)ch) return _pat_fail(c, "invalid range in character class");
+      _pat_set_range(&class, ch, hi);
+      c->pos += 2;
+      continue;
+    }
+    _pat_set_add(&class, ch);
+  }
+  if (negate) _pat_set_invert(&class);
+  c->sets[set] = class;
+  return node;
+}
+
+static int32_t _pat_literal(_PatCompiler* c, char ch) {
+  int32_t set;
+  int32_t node = _pat_set_node(c, &set);
+  if (node < 0) return -1;
+  _pat_set_add(&c->sets[set], ch);
+  return node;
+}
+
+// any byte, optionally without `except`.
+static int32_t _pat_any(_PatCompiler* c, int except) {
+  int32_t set;
+  int32_t node = _pat_set_node(c, &set);
+  if (node < 0) return -1;
+  _pat_set_range(&c->sets[set], 0, 255);
+  if (except >= 0) c->sets[set].bits[except >> 6] &= ~(1ULL << (except & 63));
+  return node;
+}
+
+static int32_t _pat_repeat(_PatCompiler* c, int32_t child, int32_t min, int32_t max) {
+  int32_t node = _pat_node(c, _PAT_REP);
+  if (node < 0) return -1;
+  c->nodes[node].child = child;
+  c->nodes[node].min = min;
+  c->nodes[node].max = max;
+  return _pat_nest(c, node, child);
+}
+
+// reads a decimal number for {m,n}. returns -1 if there is none.
+static int32_t _pat_number(_PatCompiler* c) {
+  int32_t n = -1;
+  while (c->pos < c->len && c->src[c->pos] >= '0' && c->src[c->pos] <= '9') {
+    n = ((n < 0) ? 0 : n * 10) + (c->src[c->pos++] - '0');
+    if (n > PATTERN_MAX_REPEAT) return _pat_fail(c, "repetition count is too large");
+  }
+  return n;
+}
+
+static int32_t _pat_regex_alt(_PatCompiler* c, int depth);
+
+static int32_t _pat_regex_atom(_PatCompiler* c, int depth) {
+  char ch = c->src[c->pos++];
+  switch (ch) {
+    case '(': {
+      if (depth >= PATTERN_MAX_DEPTH) return _pat_fail(c, "pattern is nested too deeply");
+      int32_t node = _pat_regex_alt(c, depth + 1);
+      if (node < 0) return -1;
+      if (c->pos >= c->len || c->src[c->pos] != ')') return _pat_fail(c, "missing )");
+      c->pos++;
+      return node;
+    }
+    case '[': return _pat_class(c, "^");
+    case '.': return _pat_any(c, '\n');
+    case '\\': {
+      int32_t set;
+      int32_t node = _pat_set_node(c, &set);
+      if (node < 0 || _pat_escape(c, &c->sets[set]) < 0) return -1;
+      return node;
+    }
+    case '*': case '+': case '?': case '{':
+      return _pat_fail(c, "nothing to repeat");
+    case '^': case '$':
+      return _pat_fail(c, "anchors are only supported at the start or end of the pattern");
+    default:
+      return _pat_literal(c, ch);
+  }
+}
+
+static int32_t _pat_regex_repeat(_PatCompiler* c, int depth) {
+  int32_t node = _pat_regex_atom(c, depth);
+  while (node >= 0 && c->pos < c->len) {
+    char ch = c->src[c->pos];
+    if (ch == '*') node = _pat_repeat(c, node, 0, -1);
+    else if (ch == '+') node = _pat_repeat(c, node, 1, -1);
+    else if (ch == '?') node = _pat_repeat(c, node, 0, 1);
+    else if (ch == '{') {
+      c->pos++;
+      int32_t min = _pat_number(c), max = min;
+      if (c->pos < c->len && c->src[c->pos] == ',') {
+        c->pos++;
+        max = _pat_number(c);
+      }
+      if (c->err != NULL) return -1;
+      if (min < 0 || c->pos >= c->len || c->src[c->pos] != '}')
+        return _pat_fail(c, "invalid repetition, expected {m}, {m,} or {m,n}");
+      if (max >= 0 && max < min) return _pat_fail(c, "invalid repetition, max is less than min");
+      node = _pat_repeat(c, node, min, max);
+    } else {
+      break;
+    }
+    c->pos++;
+  }
+  return node;
+}
+
+static int32_t _pat_regex_cat(_PatCompiler* c, int depth) {
+  int32_t cat = _pat_node(c, _PAT_CAT), last = -1;
+  if (cat < 0) return -1;
+  while (c->pos < c->len && c->src[c->pos] != '|' && !(c->src[c->pos] == ')' && depth > 0)) {
+    if (c->src[c->pos] == ')') return _pat_fail(c, "unmatched )");
+    int32_t node = _pat_regex_repeat(c, depth);
+    if (node < 0 || _pat_append(c, cat, &last, node) < 0) return -1;
+  }
+  return cat;
+}
+
+static int32_t _pat_regex_alt(_PatCompiler* c, int depth) {
+  int32_t first = _pat_regex_cat(c, depth);
+  if (first < 0 || c->pos >= c->len || c->src[c->pos] != '|') return first;
+  int32_t alt = _pat_node(c, _PAT_ALT), last = -1;
+  if (alt < 0 || _pat_append(c, alt, &last, first) < 0) return -1;
+  while (c->pos < c->len && c->src[c->pos] == '|') {
+    c->pos++;
+    int32_t node = _pat_regex_cat(c, depth);
+    if (node < 0 || _pat_append(c, alt, &last, node) < 0) return -1;
+  }
+  return alt;
+}
+
+// parses glob syntax up to the end, or up to ',' / '}' inside braces.
+static int32_t _pat_glob_seq(_PatCompiler* c, int depth) {
+  int32_t cat = _pat_node(c, _PAT_CAT), last = -1;
+  if (cat < 0) return -1;
+  while (c->pos < c->len) {
+    char ch = c->src[c->pos];
+    if (depth > 0 && (ch == ',' || ch == '}')) break;
+    c->pos++;
+    int32_t node;
+    if (ch == '*') {
+      bool any_dir = c->pos < c->len && c->src[c->pos] == '*';
+      if (any_dir) c->pos++;
+      node = _pat_any(c, any_dir ? -1 : '/');
+      if (node >= 0) node = _pat_repeat(c, node, 0, -1);
+    } else if (ch == '?') {
+      node = _pat_any(c, '/');
+    } else if (ch == '[') {
+      node = _pat_class(c, "!^");
+    } else if (ch == '{') {
+      if (depth >= PATTERN_MAX_DEPTH) return _pat_fail(c, "pattern is nested too deeply");
+      node = _pat_node(c, _PAT_ALT);
+      int32_t alt_last = -1;
+      while (node >= 0) {
+        int32_t option = _pat_glob_seq(c, depth + 1);
+        if (option < 0 || _pat_append(c, node, &alt_last, option) < 0) return -1;
+        if (c->pos >= c->len) return _pat_fail(c, "missing }");
+        if (c->src[c->pos++] == '}') break;
+      }
+    } else if (ch == '\\') {
+      if (c->pos >= c->len) return _pat_fail(c, "trailing backslash");
+      node = _pat_literal(c, c->src[c->pos++]);
+    } else {
+      node = _pat_literal(c, ch);
+    }
+    if (node < 0 || _pat_append(c, cat, &last, node) < 0) return -1;
+  }
+  return cat;
+}
+
+static int32_t _pat_state(_PatCompiler* c, uint8_t type, int32_t set, int32_t out1, int32_t out2) {
+  if (c->n_nfa >= PATTERN_MAX_STATES * 16) return _pat_fail(c, "pattern is too large");
+  if (!_pat_grow((void**)&c->nfa, &c->cap_nfa, c->n_nfa, sizeof(_PatState)))
+    return _pat_fail(c, "failed to allocate memory for the pattern");
+  c->nfa[c->n_nfa] = (_PatState) { type, set, out1, out2 };
+  return c->n_nfa++;
+}
+
+static int32_t _pat_build(_PatCompiler* c, int32_t node, int32_t next, bool reverse);
+
+// reverses the sibling list starting at `child`, returns its new head.
+static int32_t _pat_reverse_siblings(_PatCompiler* c, int32_t child) {
+  int32_t head = -1;
+  while (child >= 0) {
+    int32_t sibling = c->nodes[child].sibling;
+    c->nodes[child].sibling = head;
+    head = child;
+    child = sibling;
+  }
+  return head;
+}
+
+// builds the children of a _PAT_CAT starting at `child`. each child is built
+// in front of the one after it, so the forward pattern goes through the list
+// backwards; the reversed pattern simply goes through it in order.
+static int32_t _pat_build_cat(_PatCompiler* c, int32_t child, int32_t next, bool reverse) {
+  int32_t head = reverse ? child : _pat_reverse_siblings(c, child);
+  for (int32_t i = head; i >= 0 && next >= 0; i = c->nodes[i].sibling)
+    next = _pat_build(c, i, next, reverse);
+  if (!reverse) _pat_reverse_siblings(c, head);
+  return next;
+}
+
+// Thompson construction of `node` in front of the state `next`.
+// Returns the entry state of the fragment.
+static int32_t _pat_build(_PatCompiler* c, int32_t node, int32_t next, bool reverse) {
+  if (next < 0) return -1;
+  _PatNode n = c->nodes[node];
+  switch (n.type) {
+    case _PAT_SET:
+      return _pat_state(c, _NFA_SET, n.set, next, -1);
+    case _PAT_CAT:
+      return _pat_build_cat(c, n.child, next, reverse);
+    case _PAT_ALT: {
+      int32_t entry = -1;
+      for (int32_t child = n.child; child >= 0; child = c->nodes[child].sibling) {
+        int32_t option = _pat_build(c, child, next, reverse);
+        entry = (entry < 0) ? option : _pat_state(c, _NFA_SPLIT, -1, entry, option);
+        if (option < 0 || entry < 0) return -1;
+      }
+      return entry;
+    }
+    case _PAT_REP: {
+      int32_t tail = next;
+      if (n.max < 0) { // child* loops back through a split
+        int32_t split = _pat_state(c, _NFA_SPLIT, -1, -1, next);
+        if (split < 0) return -1;
+        int32_t body = _pat_build(c, n.child, split, reverse);
+        if (body < 0) return -1;
+        c->nfa[split].out1 = body;
+        tail = split;
+      } else { // (child(child)?)? for the optional max - min copies
+        for (int32_t i = n.min; i < n.max && tail >= 0; i++)
+          tail = _pat_state(c, _NFA_SPLIT, -1, _pat_build(c, n.child, tail, reverse), next);
+      }
+      for (int32_t i = 0; i < n.min && tail >= 0; i++)
+        tail = _pat_build(c, n.child, tail, reverse);
+      return tail;
+    }
+    default:
+      return next;
+  }
+}
+
+// adds the epsilon closure of the `n` states in `stack` to `out`.
+// only byte consuming and match states end up in `out`.
+static void _pat_closure(const _PatCompiler* c, int32_t* stack, int32_t n, uint64_t* out, uint64_t* visited) {
+  int32_t words = (c->n_nfa + 63) / 64;
+  memset(visited, 0, words * sizeof(uint64_t));
+  while (n > 0) {
+    int32_t s = stack[--n];
+    if ((visited[s >> 6] >> (s & 63)) & 1) continue;
+    visited[s >> 6] |= 1ULL << (s & 63);
+    if (c->nfa[s].type == _NFA_SPLIT) {
+      stack[n++] = c->nfa[s].out1;
+      stack[n++] = c->nfa[s].out2;
+    } else {
+      out[s >> 6] |= 1ULL << (s & 63);
+    }
+  }
+}
+
+static const char _PAT_TOO_COMPLEX[] = "pattern is too complex";
+
+typedef struct {
+  int32_t n_states;
+  int32_t* table;
+  int32_t* scan; // only built on request, see _pat_dfa()
+  uint8_t* accept;
+} _PatDfa;
+
+// subset construction. with `unanchored` the start state is merged into
+// every state, which is the same as prefixing the pattern with .*
+// with `scan` a second table is built in which every transition merges the
+// start state in, so that a search can start new attempts for a while and
+// then switch to only following the running ones.
+static const char* _pat_dfa(const _PatCompiler* c, int32_t start, int32_t match, bool unanchored, bool scan,
+                            const uint8_t* class_rep, uint32_t n_classes, _PatDfa* dfa) {
+  const char* err = NULL;
+  int32_t words = (c->n_nfa + 63) / 64;
+  int32_t cap = 64, hash_cap = 256;
+  uint64_t* sets = malloc(cap * words * sizeof(uint64_t));
+  int32_t* table = malloc(cap * n_classes * sizeof(int32_t));
+  int32_t* scan_table = scan ? malloc(cap * n_classes * sizeof(int32_t)) : NULL;
+  uint8_t* accept = malloc(cap);
+  int32_t* hash = malloc(hash_cap * sizeof(int32_t));
+  int32_t* stack = malloc((3 * c->n_nfa + 2) * sizeof(int32_t));
+  uint64_t* visited = malloc(words * sizeof(uint64_t));
+  uint64_t* next = malloc(words * sizeof(uint64_t));
+  if (!sets || !table || (scan && !scan_table) || !accept || !hash || !stack || !visited || !next) {
+    err = "failed to allocate memory for the DFA";
+    goto done;
+  }
+  for (int32_t i = 0; i < hash_cap; i++) hash[i] = -1;
+
+  // a search only ever takes scan transitions and then plain ones. so the
+  // first pass builds the states reachable through scan transitions alone,
+  // the second one the plain transitions of every state. states that are
+  // only reached through plain transitions have no scan transitions (-1).
+  int32_t n_states = 0;
+  for (int pass = scan ? 0 : 1; pass < 2; pass++) {
+    for (int32_t d = (pass == 0 || !scan) ? -1 : 0; d < n_states; d++) {
+      for (uint32_t k = 0; k < ((d < 0) ? 1 : n_classes); k++) {
+        // the set reached from state d on class k. d = -1 builds the start state.
+        bool inject = unanchored || pass == 0;
+        int32_t sp = 0;
+        memset(next, 0, words * sizeof(uint64_t));
+        if (d < 0 || inject) stack[sp++] = start;
+        for (int32_t w = 0; d >= 0 && w < words; w++) {
+          for (uint64_t bits = sets[d * words + w]; bits != 0; bits &= bits - 1) {
+            int32_t s = w * 64 + __builtin_ctzll(bits);
+            if (c->nfa[s].type == _NFA_SET && _pat_set_has(&c->sets[c->nfa[s].set], class_rep[k]))
+              stack[sp++] = c->nfa[s].out1;
+          }
+        }
+        _pat_closure(c, stack, sp, next, visited);
+
+        bool empty = true;
+        uint64_t h = 14695981039346656037ULL;
+        for (int32_t w = 0; w < words; w++) {
+          if (next[w] != 0) empty = false;
+          h = (h ^ next[w]) * 1099511628211ULL;
+        }
+        int32_t target = -1;
+        if (!empty) {
+          uint32_t slot = h & (hash_cap - 1);
+          while (hash[slot] >= 0 && memcmp(&sets[hash[slot] * words], next, words * sizeof(uint64_t)) != 0)
+            slot = (slot + 1) & (hash_cap - 1);
+          target = hash[slot];
+          if (target < 0) { // new state
+            if (n_states >= PATTERN_MAX_STATES) {
+              err = _PAT_TOO_COMPLEX;
+              goto done;
+            }
+            if (n_states == cap) {
+              cap *= 2;
+              uint64_t* new_sets = realloc(sets, cap * words * sizeof(uint64_t));
+              if (new_sets) sets = new_sets;
+              int32_t* new_table = realloc(table, cap * n_classes * sizeof(int32_t));
+              if (new_table) table = new_table;
+              int32_t* new_scan = scan ? realloc(scan_table, cap * n_classes * sizeof(int32_t)) : NULL;
+              if (new_scan) scan_table = new_scan;
+              uint8_t* new_accept = realloc(accept, cap);
+              if (new_accept) accept = new_accept;
+              if (!new_sets || !new_table || (scan && !new_scan) || !new_accept) {
+                err = "failed to allocate memory for the DFA";
+                goto done;
+              }
+            }
+            target = n_states++;
+            if (pass == 1 && scan) {
+              for (uint32_t j = 0; j < n_classes; j++) scan_table[target * n_classes + j] = -1;
+            }
+            memcpy(&sets[target * words], next, words * sizeof(uint64_t));
+            accept[target] = (next[match >> 6] >> (match & 63)) & 1;
+            hash[slot] = target;
+            if (n_states * 2 > hash_cap) { // rehash
+              int32_t* new_hash = malloc(hash_cap * 2 * sizeof(int32_t));
+              if (new_hash == NULL) {
+                err = "failed to allocate memory for the DFA";
+                goto done;
+              }
+              free(hash);
+              hash = new_hash;
+              hash_cap *= 2;
+              for (int32_t i = 0; i < hash_cap; i++) hash[i] = -1;
+              for (int32_t i = 0; i < n_states; i++) {
+                uint64_t hi = 14695981039346656037ULL;
+                for (int32_t w = 0; w < words; w++) hi = (hi ^ sets[i * words + w]) * 1099511628211ULL;
+                uint32_t s = hi & (hash_cap - 1);
+                while (hash[s] >= 0) s = (s + 1) & (hash_cap - 1);
+                hash[s] = i;
+              }
+            }
+          }
+        }
+        if (d >= 0) ((pass == 0) ? scan_table : table)[d * n_classes + k] = target;
+      }
+    }
+  }
+  dfa->n_states = n_states;
+  dfa->table = table;
+  dfa->scan = scan_table;
+  dfa->accept = accept;
+  table = NULL;
+  scan_table = NULL;
+  accept = NULL;
+
+done:
+  free(sets), free(table), free(scan_table), free(accept), free(hash), free(stack), free(visited), free(next);
+  return err;
+}
+
+static void _pat_compiler_free(_PatCompiler* c) {
+  free(c->nodes);
+  free(c->sets);
+  free(c->nfa);
+}
+
+// lowers the syntax tree `root` of `c` into a Pattern allocated in `arena`.
+// returns NULL with the reason in *err on failure.
+static Pattern* _pat_finish(_PatCompiler* c, Arena* arena, int32_t root, bool anchor_start, bool anchor_end, const char** err) {
+  // split the bytes into classes that no set of the pattern tells apart.
+  uint8_t classes[256] = {0};
+  uint32_t n_classes = 1;
+  for (int32_t i = 0; i < c->n_sets; i++) {
+    int16_t remap[256][2];
+    memset(remap, -1, sizeof(remap));
+    uint32_t n = 0;
+    for (int ch = 0; ch < 256; ch++) {
+      int in = _pat_set_has(&c->sets[i], ch);
+      if (remap[classes[ch]][in] < 0) remap[classes[ch]][in] = n++;
+      classes[ch] = remap[classes[ch]][in];
+    }
+    n_classes = n;
+  }
+  uint8_t class_rep[256];
+  for (int ch = 255; ch >= 0; ch--) class_rep[classes[ch]] = ch;
+
+  int32_t match = _pat_state(c, _NFA_MATCH, -1, -1, -1);
+  int32_t fwd_start = _pat_build(c, root, match, false);
+  int32_t rev_start = _pat_build(c, root, match, true);
+  if (fwd_start < 0 || rev_start < 0 || c->err != NULL) {
+    *err = c->err;
+    return NULL;
+  }
+
+  _PatDfa fwd = {0}, rev = {0};
+  // the scan table is only read by unanchored searches. if its states don't
+  // fit, searches do without it.
+  bool scan = !anchor_start && !anchor_end;
+  *err = _pat_dfa(c, fwd_start, match, false, scan, class_rep, n_classes, &fwd);
+  if (scan && *err == _PAT_TOO_COMPLEX) {
+    *err = _pat_dfa(c, fwd_start, match, false, false, class_rep, n_classes, &fwd);
+  }
+  if (*err == NULL) *err = _pat_dfa(c, rev_start, match, !anchor_end, false, class_rep, n_classes, &rev);
+
+  Pattern* p = NULL;
+  if (*err == NULL) {
+    p = arena_alloc_aligned(arena, sizeof(Pattern), _Alignof(Pattern));
+    int32_t* fwd_table = arena_alloc_aligned(arena, fwd.n_states * n_classes * sizeof(int32_t), _Alignof(int32_t));
+    int32_t* fwd_scan = (fwd.scan != NULL)
+      ? arena_alloc_aligned(arena, fwd.n_states * n_classes * sizeof(int32_t), _Alignof(int32_t)) : NULL;
+    int32_t* rev_table = arena_alloc_aligned(arena, rev.n_states * n_classes * sizeof(int32_t), _Alignof(int32_t));
+    uint8_t* fwd_accept = arena_alloc(arena, fwd.n_states);
+    uint8_t* rev_accept = arena_alloc(arena, rev.n_states);
+    if (!p || !fwd_table || (fwd.scan && !fwd_scan) || !rev_table || !fwd_accept || !rev_accept) {
+      *err = "pattern doesn't fit in the arena";
+      p = NULL;
+    } else {
+      memcpy(p->classes, classes, sizeof(classes));
+      p->n_classes = n_classes;
+      p->fwd_states = fwd.n_states;
+      p->rev_states = rev.n_states;
+      p->fwd = memcpy(fwd_table, fwd.table, fwd.n_states * n_classes * sizeof(int32_t));
+      p->fwd_scan = fwd_scan ? memcpy(fwd_scan, fwd.scan, fwd.n_states * n_classes * sizeof(int32_t)) : NULL;
+      p->rev = memcpy(rev_table, rev.table, rev.n_states * n_classes * sizeof(int32_t));
+      p->fwd_accept = memcpy(fwd_accept, fwd.accept, fwd.n_states);
+      p->rev_accept = memcpy(rev_accept, rev.accept, rev.n_states);
+      p->anchor_start = anchor_start;
+      p->anchor_end = anchor_end;
+    }
+  }
+  free(fwd.table), free(fwd.scan), free(fwd.accept), free(rev.table), free(rev.accept);
+  return p;
+}
+
+/* ---------------- public API ---------------- */
+
+// Compiles `len` bytes of `regex` into a Pattern allocated in `arena`.
+// Returns NULL on syntax errors, if the pattern is too complex or if it
+// doesn't fit in the arena.
+Pattern* pattern_compile(Arena* arena, const char* regex, uint64_t len) {
+  _PatCompiler c = { .src = regex, .len = len };
+  bool anchor_start = false, anchor_end = false;
+  if (c.len > 0 && regex[0] == '^') {
+    anchor_start = true;
+    c.pos = 1;
+  }
+  if (c.len > c.pos && regex[c.len - 1] == '$') {
+    uint64_t backslashes = 0;
+    while (backslashes < c.len - 1 && regex[c.len - 2 - backslashes] == '\\') backslashes++;
+    if (backslashes % 2 == 0) { // "\$" is a literal dollar
+      anchor_end = true;
+      c.len--;
+    }
+  }
+
+  int32_t root = _pat_regex_alt(&c, 0);
+  if (root >= 0 && c.pos < c.len) root = _pat_fail(&c, "unmatched )");
+  const char* err = c.err;
+  Pattern* p = (root >= 0) ? _pat_finish(&c, arena, root, anchor_start, anchor_end, &err) : NULL;
+  _pat_compiler_free(&c);
+  if (p == NULL) return_bad(pattern_err, NULL, err);
+  return_ok(pattern_err, p);
+}
+
+// Compiles `len` bytes of `glob` into a Pattern allocated in `arena`.
+// Globs are anchored at both ends. Returns NULL on failure.
+Pattern* pattern_glob(Arena* arena, const char* glob, uint64_t len) {
+  _PatCompiler c = { .src = glob, .len = len };
+  int32_t root = _pat_glob_seq(&c, 0);
+  const char* err = c.err;
+  Pattern* p = (root >= 0) ? _pat_finish(&c, arena, root, true, true, &err) : NULL;
+  _pat_compiler_free(&c);
+  if (p == NULL) return_bad(pattern_err, NULL, err);
+  return_ok(pattern_err, p);
+}
+
+static inline int32_t _pat_step(const Pattern* p, const int32_t* table, int32_t state, char ch) {
+  return table[state * p->n_classes + p->classes[(uint8_t)ch]];
+}
+
+// Returns true if the whole of `s` matches `p`.
+bool pattern_match(const Pattern* p, const String* s) {
+  int32_t state = 0;
+  for (uint64_t i = 0; i < s->length; i++) {
+    state = _pat_step(p, p->fwd, state, s->str[i]);
+    if (state < 0) return_ok(pattern_err, false);
+  }
+  return_ok(pattern_err, p->fwd_accept[state]);
+}
+
+// end of the longest match starting exactly at `start`, -1 if none.
+static int64_t _pat_longest(const Pattern* p, const String* s, uint64_t start) {
+  int32_t state = 0;
+  int64_t end = p->fwd_accept[0] ? (int64_t)start : -1;
+  for (uint64_t i = start; i < s->length; i++) {
+    state = _pat_step(p, p->fwd, state, s->str[i]);
+    if (state < 0) break;
+    if (p->fwd_accept[state]) end = i + 1;
+  }
+  return end;
+}
+
+// leftmost start in [start, end] of a match that ends at or before `end`, -1 if none.
+// every position where the reversed DFA accepts is the start of such a match.
+static int64_t _pat_rev_leftmost(const Pattern* p, const String* s, uint64_t start, uint64_t end) {
+  int32_t state = 0;
+  int64_t found = p->rev_accept[0] ? (int64_t)end : -1;
+  for (uint64_t i = end; i > start; i--) {
+    state = _pat_step(p, p->rev, state, s->str[i - 1]);
+    if (state < 0) break;
+    if (p->rev_accept[state]) found = i - 1;
+  }
+  return found;
+}
+
+// runs the forward DFA from `start`, starting a new match attempt at every
+// position before `until`. returns the first (`first`) or the last position
+// where one of the attempts matches, -1 if none does.
+static int64_t _pat_scan(const Pattern* p, const String* s, uint64_t start, uint64_t until, bool first) {
+  int32_t state = 0;
+  int64_t end = p->fwd_accept[0] ? (int64_t)start : -1;
+  for (uint64_t i = start; i < s->length && !(first && end >= 0); i++) {
+    state = _pat_step(p, (i + 1 < until) ? p->fwd_scan : p->fwd, state, s->str[i]);
+    if (state < 0) break;
+    if (p->fwd_accept[state]) end = i + 1;
+  }
+  return end;
+}
+
+// start of the leftmost match at or after `start`, -1 if none.
+static int64_t _pat_leftmost(const Pattern* p, const String* s, uint64_t start) {
+  if (p->anchor_start) {
+    if (start > 0) return -1;
+    int64_t end = _pat_longest(p, s, 0);
+    return (end < 0 || (p->anchor_end && (uint64_t)end != s->length)) ? -1 : 0;
+  }
+  // the reversed DFA is anchored at the end, it dies as soon as the tail can't match.
+  // without a scan table the whole rest of the string is scanned back.
+  if (p->anchor_end || p->fwd_scan == NULL) return _pat_rev_leftmost(p, s, start, s->length);
+
+  int64_t end = _pat_scan(p, s, start, UINT64_MAX, true);
+  if (end < 0) return -1;
+  int64_t found = _pat_rev_leftmost(p, s, start, end);
+  if (found <= (int64_t)start) return found;
+  // matches starting before `found` end after `end`. follow only those
+  // attempts until they die; the reversed DFA from their last end covers them all.
+  end = _pat_scan(p, s, start, found, false);
+  return (end < 0) ? found : _pat_rev_leftmost(p, s, start, end);
+}
+
+// Returns the index of the leftmost match of `p` at or after `start`
+// within `s`, or BAD if there is none.
+int64_t pattern_search(const Pattern* p, const String* s, uint64_t start) {
+  if (start > s->length) return_bad(pattern_err, BAD, "invalid start index");
+  int64_t found = _pat_leftmost(p, s, start);
+  if (found < 0) return_bad(pattern_err, BAD, "no match");
+  return_ok(pattern_err, found);
+}
+
+// Returns a non-owning, non-mutable slice of the leftmost-longest match of
+// `p` at or after `start` within `s`. The slice may be empty if the
+// pattern matches the empty string. Returns STR_EMPTY if there is no match.
+String pattern_capture(const Pattern* p, const String* s, uint64_t start) {
+  if (start > s->length) return_bad(pattern_err, STR_EMPTY, "invalid start index");
+  int64_t found = _pat_leftmost(p, s, start);
+  if (found < 0) return_bad(pattern_err, STR_EMPTY, "no match");
+  int64_t end = _pat_longest(p, s, found);
+  String capture = {
+    .str = s->str + found,
+    .length = end - found,
+    .capacity = s->capacity,
+    .mutable = false,
+    .shared = s->shared,
+    .offset = s->offset + found,
+  };
+  return_ok(pattern_err, capture);
+}
+
+// shorthand of pattern_compile() using String types.
+#define spattern_compile(arena, str) pattern_compile(arena, (str)->str, (str)->length)
+
+// shorthand of pattern_glob() using String types.
+#define spattern_glob(arena, str) pattern_glob(arena, (str)->str, (str)->length)
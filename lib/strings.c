@@ -14,6 +14,14 @@
  * (immutable).The library won't allow any mutable operations
  * (such as insert, copy) to modify immutable strings.
  *
+ * Strings can also be shared. str_share() puts a reference count in front
+ * of the buffer and returns another owner of it; after that str_dup() is
+ * O(1) and str_free() only drops a reference. The first mutating operation
+ * on a string whose buffer has other owners copies it first (copy-on-write).
+ * The first str_share() of a string moves its buffer to make room for the
+ * count, so slices taken from it before that point are invalidated, just
+ * like after an operation that grows it.
+ *
  * [NOTE] Error handling:
  * The library handles errors using return values and a global error message
  * buffer (str_err_buf). Functions return OK for success, BAD for general errors,
@@ -48,6 +56,10 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <string.h>
+
+#include "arena.c"
+#include "trace.c"
 
 #include "err.c"
 _Thread_local signed char str_err[ERR_BUF_SIZE];
@@ -56,7 +68,7 @@ _Thread_local signed char str_err[ERR_BUF_SIZE];
 #define STR_DYNAMIC 0
 #define STR_BEGIN 0
 #define STR_END -1
-#define STR_EMPTY ((String) { NULL, 0, 0, 0, 0 })
+#define STR_EMPTY ((String) { NULL, 0, 0, 0, 0, 0 })
 
 typedef struct {
   char* str;
@@ -64,9 +76,34 @@ typedef struct {
   uint64_t length;
   int64_t offset;
   bool mutable; // for handling slices.
+  bool shared;  // buffer is reference counted, see str_share().
 } String;
 
-const float _STR_SCALE_FACTOR = 2.0; // internal scale factor for resizing
+// header in front of the buffer of a shared string.
+typedef struct {
+  uint64_t refs; // owners of the buffer. updated atomically.
+  uint64_t _pad; // keeps the buffer 16 byte aligned, like malloc() does.
+} _StrShared;
+
+static inline _StrShared* _str_header(const String* s) {
+  return (_StrShared*)(s->str - s->offset - sizeof(_StrShared));
+}
+
+// start of the allocation behind `s`.
+static inline void* _str_block(const String* s) {
+  return s->shared ? (void*)_str_header(s) : (void*)(s->str - s->offset);
+}
+
+// Growth policy shared by every function that grows a String: the capacity is
+// multiplied by STR_GROWTH_NUM / STR_GROWTH_DEN, or set to the required size if
+// that is larger. Geometric growth keeps a loop of appends at a logarithmic
+// number of reallocations. Define both before including this file to change it.
+#ifndef STR_GROWTH_NUM
+#define STR_GROWTH_NUM 2
+#endif
+#ifndef STR_GROWTH_DEN
+#define STR_GROWTH_DEN 1
+#endif
 
 // Calculates the length of a null-terminated C string.
 // Returns the length of the string (excluding the null terminator).
@@ -105,30 +142,104 @@ uint64_t _ceil(double x) {
     return (uint64_t)(x + 1);
 }
 
+// Makes `s` the only owner of its buffer before it gets modified. If the buffer
+// is shared with other strings, it is copied into a private buffer of at least
+// `capacity` bytes (offset included). Used internally by every mutating function.
+// Returns OK on success, HALT on a slice of a shared string or on memory allocation failure.
+static int8_t _str_unshare(String* s, uint64_t capacity) {
+  if (!s->shared) return_ok(str_err, OK);
+  _StrShared* header = _str_header(s);
+  if (__atomic_load_n(&header->refs, __ATOMIC_ACQUIRE) == 1) return_ok(str_err, OK);
+  if (!s->mutable)
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice of a shared string");
+
+  uint64_t used = s->offset + s->length;
+  if (capacity < used) capacity = used;
+  if (capacity == 0) capacity = 1;
+  char* buf = malloc(capacity);
+  if (buf == NULL) {
+    return_halt(str_err, HALT, "malloc() failed");
+  }
+  memcpy(buf, s->str - s->offset, used);
+  if (__atomic_sub_fetch(&header->refs, 1, __ATOMIC_ACQ_REL) == 0) free(header);
+  s->str = buf + s->offset;
+  s->capacity = capacity;
+  s->shared = false;
+  return_ok(str_err, OK);
+}
+
+// Reallocates the underlying buffer to exactly `capacity` bytes (offset included).
+// The caller makes sure that `capacity` covers the offset and the length.
+static int8_t _str_realloc(String* s, uint64_t capacity) {
+  TRACE_LIB_FUNC();
+  if (!s->mutable)
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
+  if (capacity == 0) capacity = 1;
+  if (_str_unshare(s, capacity) != OK)
+    return_halt(str_err, HALT, "failed to unshare string");
+  if (s->capacity == capacity) return_ok(str_err, OK);
+  uint64_t head = s->shared ? sizeof(_StrShared) : 0;
+  char* tmp = realloc(_str_block(s), head + capacity);
+  if (tmp == NULL) {
+    return_halt(str_err, HALT, "realloc() failed");
+  }
+  s->str = tmp + head + s->offset;
+  s->capacity = capacity;
+  return_ok(str_err, OK);
+}
+
+// Grows the underlying buffer to hold at least `min_capacity` bytes (offset included),
+// following the growth policy (STR_GROWTH_NUM / STR_GROWTH_DEN).
+// Returns OK on success, HALT if `s` is a non-mutable slice or on memory allocation failure.
+static int8_t _str_grow(String* s, uint64_t min_capacity) {
+  if (!s->mutable)
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
+  if (min_capacity <= s->capacity) return_ok(str_err, OK);
+  uint64_t capacity = s->capacity / STR_GROWTH_DEN * STR_GROWTH_NUM
+                    + s->capacity % STR_GROWTH_DEN * STR_GROWTH_NUM / STR_GROWTH_DEN;
+  if (capacity < min_capacity) capacity = min_capacity;
+  return _str_realloc(s, capacity);
+}
+
 // Resizes the underlying buffer of the string by multiplying the capacity with the scale factor.
-// This function is primarily used internally.
-// Returns OK on success, BAD if the string is a non-mutable slice, HALT on memory allocation failure.
+// Prefer str_reserve(), which never shrinks the string.
+// Returns OK on success, BAD if the new capacity can't hold the string, HALT
+// if the string is a non-mutable slice or on memory allocation failure.
 int8_t str_scale(String* s, float scale_factor) {
   if (!s->mutable)
     return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
-
-  int64_t offset = str_rewind(s);
-  char* tmp = realloc(s->str, _ceil((float)s->capacity * scale_factor));
-  if (tmp == NULL) {
-    return_halt(str_err, HALT, "Failed to scale string!");
+  uint64_t capacity = _ceil((double)s->capacity * scale_factor);
+  if (capacity < s->offset + s->length) {
+    return_bad(str_err, BAD, "scale factor is too small to hold the string");
   }
-  s->str = tmp;
-  str_offset(s, offset);
+  return _str_realloc(s, capacity);
+}
 
-  s->capacity *= scale_factor;
-  return_ok(str_err, OK);
+// Makes sure that `s` can hold `capacity` bytes (from its current offset)
+// without reallocating. Never shrinks the buffer.
+// Returns OK on success, HALT if `s` is a non-mutable slice or on memory allocation failure.
+int8_t str_reserve(String* s, uint64_t capacity) {
+  if (!s->mutable)
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
+  if (s->offset + capacity <= s->capacity) return_ok(str_err, OK);
+  return _str_realloc(s, s->offset + capacity);
+}
+
+// Releases the unused capacity at the end of the buffer.
+// Returns OK on success, HALT if `s` is a non-mutable slice or on memory allocation failure.
+int8_t str_shrink_to_fit(String* s) {
+  if (!s->mutable)
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
+  if (s->offset + s->length == s->capacity) return_ok(str_err, OK);
+  return _str_realloc(s, s->offset + s->length);
 }
 
 // Prints detailed debug information about a String object. This is primarily for internal debugging.
 void _str_debug_print(const char* var, const String* s) {
   err_status(str_err);
-  printf("%s::{ capacity:%lu, length:%lu, offset:%lu, mutable:%s, str:%p };\n", 
-         var, s->capacity, s->length, s->offset, (s->mutable) ?"yes":"no", s->str);
+  printf("%s::{ capacity:%lu, length:%lu, offset:%lu, mutable:%s, refs:%lu, str:%p };\n",
+         var, s->capacity, s->length, s->offset, (s->mutable) ?"yes":"no",
+         (s->shared) ? __atomic_load_n(&_str_header(s)->refs, __ATOMIC_RELAXED) : 1, s->str);
   if (s->str == NULL) return;
   printf("%s => \"", var);
   if (s->length <= 75) {
@@ -136,11 +247,16 @@ void _str_debug_print(const char* var, const String* s) {
       printf("%c", s->str[i]);
     }
   } else {
-    for (size_t i = 0; i <= 20; i++) {
+    // move the cut points off UTF-8 continuation bytes (10xxxxxx)
+    // so that multi-byte sequences are printed whole.
+    size_t head = 21, tail = s->length - 20;
+    while (head < s->length && (s->str[head] & 0xC0) == 0x80) head++;
+    while (tail < s->length && (s->str[tail] & 0xC0) == 0x80) tail++;
+    for (size_t i = 0; i < head; i++) {
       printf("%c", s->str[i]);
     }
     printf("... ...");
-    for (size_t i = s->length - 20; i < s->length; i++) {
+    for (size_t i = tail; i < s->length; i++) {
       printf("%c", s->str[i]);
     }
   }
@@ -172,6 +288,7 @@ String str_declare(int64_t capacity) {
 // Initializes a String from a null-terminated C string.
 // Returns STR_EMPTY on failure.
 String str_init(const char* s) {
+  TRACE_LIB_FUNC();
   String str = str_declare(str_len(s));
   if (str.str == STR_EMPTY.str) {
     return_halt(str_err, STR_EMPTY, "failed to allocate memory for s");    
@@ -192,12 +309,12 @@ String str_init(const char* s) {
   if (pos > s->length || pos < 0) { // check for invalid pos
     return_bad(str_err, BAD, "invalid access position");
   }
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare str");
+  }
   // deal with string capacity
-  if (s->length == s->capacity) { // string is full
-    int8_t ret = str_scale(s, _STR_SCALE_FACTOR);
-    if (ret == BAD) return_bad(str_err, ret, "failed to scale str");
-    else if (ret == HALT) return_halt(str_err, ret, "failed to scale str");
-    
+  if (_str_grow(s, s->offset + s->length + 1) != OK) {
+    return_halt(str_err, HALT, "failed to grow str");
   }
   // assign ch to required pos
   for (int64_t i = s->length - 1; i >= pos; i--) {
@@ -221,6 +338,9 @@ char str_remove(String* s, int64_t pos) {
   if (pos >= s->length || pos < 0) { // check for invalid pos
     return_bad(str_err, BAD, "invalid access positon");
   }
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare str");
+  }
 
   char ch = s->str[pos];
   s->length--;
@@ -230,9 +350,44 @@ char str_remove(String* s, int64_t pos) {
   return_ok(str_err, ch);
 }
 
-// Returns a deep copy of the given string. The caller is responsible for freeing the memory.
+// Turns `s` into a shared string (if it isn't one yet) and returns another owner
+// of the same buffer in O(1). Both have to be released with str_free(); the
+// buffer is freed with its last owner. Modifying either of them copies the
+// buffer first, so they never see each other's changes.
+// Sharing a string for the first time reallocates its buffer to put the
+// reference count in front of it: slices taken from `s` before are invalid
+// afterwards. Take them from the shared string instead.
+// Returns STR_EMPTY on failure.
+String str_share(String* s) {
+  TRACE_LIB_FUNC();
+  if (!s->mutable || s->str == NULL) {
+    return_halt(str_err, STR_EMPTY, "Illegal action. Can't share a slice");
+  }
+  if (!s->shared) { // make room for the header in front of the buffer
+    uint64_t used = s->offset + s->length;
+    char* block = realloc(s->str - s->offset, sizeof(_StrShared) + s->capacity);
+    if (block == NULL) {
+      return_halt(str_err, STR_EMPTY, "realloc() failed");
+    }
+    memmove(block + sizeof(_StrShared), block, used);
+    ((_StrShared*)block)->refs = 1;
+    s->str = block + sizeof(_StrShared) + s->offset;
+    s->shared = true;
+  }
+  __atomic_add_fetch(&_str_header(s)->refs, 1, __ATOMIC_RELAXED);
+  return_ok(str_err, *s);
+}
+
+// Returns a copy of the given string. The caller is responsible for freeing the memory.
+// Shared strings (see str_share()) are duplicated in O(1) by taking another
+// reference, everything else is deep copied.
 // Returns STR_EMPTY on failure.
 String str_dup(const String* s) {
+  TRACE_LIB_FUNC();
+  if (s->shared && s->mutable) {
+    __atomic_add_fetch(&_str_header(s)->refs, 1, __ATOMIC_RELAXED);
+    return_ok(str_err, *s);
+  }
   String dup = str_declare(s->capacity);
   if (dup.str == STR_EMPTY.str) {
     return_halt(str_err, STR_EMPTY, "failed to create duplicate");
@@ -254,6 +409,7 @@ String str_slice(const String* s, uint64_t start, uint64_t end) {
     .str = s->str + start,
     .capacity = s->capacity,
     .mutable = false,
+    .shared = s->shared,
     .offset = s->offset + start,
   }; 
   return_ok(str_err, slice);
@@ -270,13 +426,17 @@ String str_slice_head(String* s, uint64_t start, uint64_t end) {
     printf("\nlength: %lu, start: %lu, end: %lu", s->length, start, end);
     return_bad(str_err, STR_EMPTY, "incorrect slice length");
   }
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, STR_EMPTY, "failed to unshare s");
+  }
 
   String slice = {
     .str = s->str,
     .length = end - start,
     .capacity = end - start,
     .offset = s->offset,
-    .mutable = false
+    .mutable = false,
+    .shared = s->shared,
   };
 
   for (int i = 0; i < slice.length; i++) {
@@ -295,6 +455,7 @@ String str_slice_head(String* s, uint64_t start, uint64_t end) {
 // The caller is responsible for freeing the memory.
 // Returns STR_EMPTY on failure.
 String str_join(const String *a, const String *b) {
+  TRACE_LIB_FUNC();
   String result = str_declare(a->capacity + b->capacity); 
   if (result.str == STR_EMPTY.str){
     return_halt(str_err, STR_EMPTY, "malloc failed.");
@@ -307,69 +468,240 @@ String str_join(const String *a, const String *b) {
   return_ok(str_err, result);
 }
 
+// Appends `len` raw bytes to the end of `s`. `bytes` may point into `s` itself.
+// Automatically resizes `s` if necessary.
+// Returns OK on success, HALT if `s` is a non-mutable slice or on memory allocation failure.
+int8_t str_append_bytes(String* s, const char* bytes, uint64_t len) {
+  TRACE_LIB_FUNC();
+  if (!s->mutable) {
+    return_halt(str_err, HALT, "Illegal action: Can't modify a slice");
+  }
+  if (len == 0) return_ok(str_err, OK);
+  // remember where `bytes` is if it lives in the buffer that may move.
+  // (unsharing keeps the offset layout, so `rel` stays valid.)
+  uintptr_t base = (uintptr_t)(s->str - s->offset);
+  bool inside = (uintptr_t)bytes >= base && (uintptr_t)bytes < base + s->capacity;
+  uint64_t rel = (uintptr_t)bytes - base;
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
+  if (_str_grow(s, s->offset + s->length + len) != OK) {
+    return_halt(str_err, HALT, "failed to grow s");
+  }
+  if (inside) bytes = s->str - s->offset + rel;
+  memmove(s->str + s->length, bytes, len);
+  s->length += len;
+  return_ok(str_err, OK);
+}
+
 // Appends the contents of `src` to the end of `dest`.
 // Automatically resizes `dest` if necessary.
-// Returns OK on success, BAD if `dest` is a non-mutable slice, HALT on memory allocation failure.
+// Returns OK on success, HALT if `dest` is a non-mutable slice or on memory allocation failure.
 int8_t str_concat(String *dest, const String* src) {
   if (!dest->mutable) {
-    return_halt(str_err, BAD, "Illegal action: Can't modify a slice"); 
-  }
-  dest->capacity += src->length;
-
-  int64_t offset = str_rewind(dest);
-  char* tmp  = realloc(dest->str, sizeof(char) * dest->capacity);
-  if(tmp == NULL) {
-    return_halt(str_err, HALT, "malloc failed.");
+    return_halt(str_err, HALT, "Illegal action: Can't modify a slice");
   }
-  dest->str = tmp;
-  str_offset(dest, offset);
-
-  for (int i = dest->length, j = 0; j < src->length; i++, j++) dest->str[i] = src->str[j];
-  dest->length += src->length;
-  return_ok(str_err, OK);
+  return str_append_bytes(dest, src->str, src->length);
 }
 
 // Replaces the contents of `dest` with the contents of `src`.
 // Automatically resizes `dest` if needed.
-// Returns OK on success, BAD if `dest` is a non-mutable slice, HALT on memory allocation failure.
+// Returns OK on success, HALT if `dest` is a non-mutable slice or on memory allocation failure.
 int8_t str_copy(String *dest, const String* src) {
+  TRACE_LIB_FUNC();
   if (!dest->mutable) {
-    return_halt(str_err, BAD, "Illegal action. Can't modify a slice"); 
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
   }
-  if (dest->capacity < src->length) {
-    dest->capacity += src->length - dest->capacity;
-
-    int64_t offset = str_rewind(dest);
-    char* tmp = realloc(dest->str, dest->capacity);
-    if (tmp == NULL) {
-      return_halt(str_err, HALT, "realloc() failed.");
-    }
-    dest->str = tmp;
-    str_offset(dest, offset);
-
+  if (src == dest) return_ok(str_err, OK);
+  if (_str_unshare(dest, dest->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare dest");
   }
-  for (int i = 0; i < src->length; i++) {
-    dest->str[i] = src->str[i];
+  if (_str_grow(dest, dest->offset + src->length) != OK) {
+    return_halt(str_err, HALT, "failed to grow dest");
   }
+  if (src->length > 0) memmove(dest->str, src->str, src->length);
   dest->length = src->length;
   return_ok(str_err, OK);
 }
 
-// Performs a lexicographical comparison between `a` and `b`.
-// Returns 0 if equal, >0 if `a` > `b`, and <0 if `a` < `b`.
+// Performs a lexicographical comparison between `a` and `b`. Bytes compare as unsigned.
+// Returns 0 if equal, 1 if `a` > `b`, and -1 if `a` < `b`.
 int32_t str_cmp(const String* a, const String* b) {
-  for (int i = 0; i < a->length && i < b->length; i++) {
-    if (a->str[i] != b->str[i]) {
-      return_ok(str_err, a->str[i] - b->str[i]);
+  uint64_t n = (a->length < b->length) ? a->length : b->length;
+  int diff = (n > 0) ? memcmp(a->str, b->str, n) : 0;
+  if (diff != 0) return_ok(str_err, (diff > 0) - (diff < 0));
+  return_ok(str_err, (a->length > b->length) - (a->length < b->length));
+}
+
+// Returns true if `a` and `b` hold the same bytes.
+// Strings of different length are rejected without looking at the contents.
+bool str_eq(const String* a, const String* b) {
+  if (a->length != b->length) return_ok(str_err, false);
+  if (a->str == b->str || a->length == 0) return_ok(str_err, true);
+  return_ok(str_err, memcmp(a->str, b->str, a->length) == 0);
+}
+
+// sort item of str_sort(): up to 8 bytes of the string starting at the
+// current window, cached big-endian so that they compare as one integer.
+typedef struct {
+  uint64_t key;
+  const char* str;
+  uint64_t length;
+  uint64_t idx; // position of the string in the input array
+} _StrSortItem;
+
+#define _STR_SORT_SMALL 32 // partitions below this size are insertion sorted
+
+static inline uint64_t _str_sort_key(const _StrSortItem* s, uint64_t depth) {
+  uint64_t key = 0;
+  for (uint64_t i = 0; i < 8; i++) {
+    key <<= 8;
+    if (depth + i < s->length) key |= (uint8_t)s->str[depth + i];
+  }
+  return key;
+}
+
+// compares two strings that are known to be equal up to `depth`.
+static inline int _str_sort_cmp(const _StrSortItem* a, const _StrSortItem* b, uint64_t depth) {
+  uint64_t n = (a->length < b->length) ? a->length : b->length;
+  int diff = (n > depth) ? memcmp(a->str + depth, b->str + depth, n - depth) : 0;
+  if (diff != 0) return diff;
+  return (a->length > b->length) - (a->length < b->length);
+}
+
+// insertion sort on the cached keys. only equal keys have to look at the strings.
+static void _str_sort_small(_StrSortItem* items, uint64_t n, uint64_t window) {
+  for (uint64_t i = 1; i < n; i++) {
+    _StrSortItem item = items[i];
+    uint64_t j = i;
+    while (j > 0) {
+      _StrSortItem* prev = &items[j - 1];
+      if (prev->key < item.key) break;
+      if (prev->key == item.key && _str_sort_cmp(prev, &item, window) <= 0) break;
+      items[j] = *prev;
+      j--;
     }
+    items[j] = item;
   }
-  return_ok(str_err, a->length - b->length);
+}
+
+// MSD radix sort of `items`, which all share their first `depth` bytes.
+// `tmp` is scratch space for at least `n` items.
+// The keys hold the 8 bytes starting at `window`, they are reloaded once
+// a partition has consumed them.
+static void _str_sort_radix(_StrSortItem* items, _StrSortItem* tmp, uint64_t n, uint64_t depth, uint64_t window) {
+  uint64_t counts[257];
+  while (n >= _STR_SORT_SMALL) {
+    if (depth == window + 8) {
+      for (uint64_t i = 0; i < n; i++) items[i].key = _str_sort_key(&items[i], depth);
+      window = depth;
+    }
+    // bucket 0 holds the strings that end here, bucket b + 1 the byte b.
+    uint32_t shift = 8 * (7 - (depth - window));
+    memset(counts, 0, sizeof(counts));
+    bool same = true; // every key is the same and no string ends inside the window
+    for (uint64_t i = 0; i < n; i++) {
+      counts[(items[i].length <= depth) ? 0 : ((items[i].key >> shift) & 0xFF) + 1]++;
+      same &= (items[i].key == items[0].key) & (items[i].length >= window + 8);
+    }
+    // a shared byte doesn't need a scatter pass, just go one level deeper,
+    // or past the whole window if the rest of it is shared as well.
+    uint32_t bucket = (items[0].length <= depth) ? 0 : ((items[0].key >> shift) & 0xFF) + 1;
+    if (counts[bucket] == n) {
+      if (bucket == 0) return; // all equal
+      depth = same ? window + 8 : depth + 1;
+      continue;
+    }
+    uint64_t offsets[257];
+    uint64_t sum = 0;
+    for (int b = 0; b < 257; b++) {
+      offsets[b] = sum;
+      sum += counts[b];
+    }
+    for (uint64_t i = 0; i < n; i++) {
+      uint32_t b = (items[i].length <= depth) ? 0 : ((items[i].key >> shift) & 0xFF) + 1;
+      tmp[offsets[b]++] = items[i];
+    }
+    memcpy(items, tmp, n * sizeof(_StrSortItem));
+    // recurse into every bucket but the largest one, which is sorted by this
+    // loop. each recursion at most halves n, so the stack stays O(log n) deep.
+    int largest = 1;
+    for (int b = 2; b < 257; b++) {
+      if (counts[b] > counts[largest]) largest = b;
+    }
+    uint64_t start = counts[0], largest_start = 0;
+    for (int b = 1; b < 257; b++) {
+      if (b == largest) largest_start = start;
+      else if (counts[b] > 1)
+        _str_sort_radix(items + start, tmp, counts[b], depth + 1, window);
+      start += counts[b];
+    }
+    items += largest_start;
+    n = counts[largest];
+    depth++;
+  }
+  _str_sort_small(items, n, window);
+}
+
+// sorts `count` items whose str and length are set, in str_cmp() order.
+// `tmp` is scratch space for `count` items.
+static void _str_sort_items(_StrSortItem* items, _StrSortItem* tmp, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) items[i].key = _str_sort_key(&items[i], 0);
+  _str_sort_radix(items, tmp, count, 0, 0);
+}
+
+// Sorts `count` strings (owned strings or slices) in place, in str_cmp() order.
+// Uses an MSD radix sort over cached 8 byte prefixes and falls back to
+// insertion sort on small partitions. Only the String structs are moved.
+// Returns OK on success, HALT on memory allocation failure.
+int8_t str_sort(String* arr, uint64_t count) {
+  TRACE_LIB_FUNC();
+  if (count < 2) return_ok(str_err, OK);
+  _StrSortItem* items = malloc(sizeof(_StrSortItem) * count * 2);
+  if (items == NULL) {
+    return_halt(str_err, HALT, "malloc failure.");
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    items[i] = (_StrSortItem) { .str = arr[i].str, .length = arr[i].length, .idx = i };
+  }
+  _str_sort_items(items, items + count, count);
+
+  // gather the strings into sorted order. the loads are independent of each
+  // other, unlike following the cycles of the permutation in place.
+  String* sorted = malloc(sizeof(String) * count);
+  if (sorted == NULL) {
+    free(items);
+    return_halt(str_err, HALT, "malloc failure.");
+  }
+  for (uint64_t i = 0; i < count; i++) sorted[i] = arr[items[i].idx];
+  memcpy(arr, sorted, sizeof(String) * count);
+  free(sorted);
+  free(items);
+  return_ok(str_err, OK);
+}
+
+// Removes adjacent duplicates from a sorted array. The unique strings are
+// kept in order at the front, the duplicates are moved behind them so that
+// the caller can still free them.
+// Returns the number of unique strings.
+uint64_t str_dedup(String* arr, uint64_t count) {
+  TRACE_LIB_FUNC();
+  if (count == 0) return_ok(str_err, 0);
+  uint64_t unique = 1;
+  for (uint64_t i = 1; i < count; i++) {
+    if (str_eq(&arr[unique - 1], &arr[i])) continue;
+    String tmp = arr[unique];
+    arr[unique++] = arr[i];
+    arr[i] = tmp;
+  }
+  return_ok(str_err, unique);
 }
 
 // Returns a new formatted String, similar to `sprintf`.
 // The caller is responsible for freeing the memory.
 // Returns STR_EMPTY on failure.
 String str_compose(const char* fmt, ...) {
+    TRACE_LIB_FUNC();
     va_list args;
     va_start(args, fmt);
     int req_length = vsnprintf(NULL, 0, fmt, args); // calculate length of the string
@@ -392,11 +724,91 @@ String str_compose(const char* fmt, ...) {
     return_ok(str_err, composed);
 }
 
+// Appends formatted output to the end of `s`, similar to `sprintf`.
+// The output is written straight into the free capacity of `s`; the buffer
+// only grows (and the format is only run again) if it doesn't fit.
+// Returns OK on success, BAD on format errors, HALT if `s` is a non-mutable
+// slice or on memory allocation failure.
+int8_t str_append_fmt(String* s, const char* fmt, ...) {
+  TRACE_LIB_FUNC();
+  if (!s->mutable) {
+    return_halt(str_err, HALT, "Illegal action. Can't modify a slice");
+  }
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
+  uint64_t used = s->offset + s->length;
+  va_list args;
+  va_start(args, fmt);
+  int req_length = vsnprintf(s->str + s->length, s->capacity - used, fmt, args);
+  va_end(args);
+  if (req_length < 0) {
+    return_bad(str_err, BAD, "Error in format string");
+  }
+
+  // vsnprintf() also needs room for the '\0', which is not part of the String.
+  if ((uint64_t)req_length >= s->capacity - used) {
+    if (_str_grow(s, used + req_length + 1) != OK) {
+      return_halt(str_err, HALT, "failed to grow s");
+    }
+    va_start(args, fmt);
+    vsnprintf(s->str + s->length, req_length + 1, fmt, args);
+    va_end(args);
+  }
+  s->length += req_length;
+  return_ok(str_err, OK);
+}
+
+// Returns a formatted String allocated in `arena`, similar to `sprintf`.
+// The result is a non-mutable view into the arena: never call str_free()
+// on it, free the arena instead. The output is formatted straight into the
+// unused space of the arena, and only formatted again if it doesn't fit.
+// Returns STR_EMPTY on failure.
+String str_compose_arena(Arena* arena, const char* fmt, ...) {
+  TRACE_LIB_FUNC();
+  // the first chunk with unused space is where a small allocation would go.
+  Arena* current = arena;
+  while (current->next_arena != NULL && current->buf_size == current->capacity) {
+    current = current->next_arena;
+  }
+  char* buf = (char*)current->arena_buf + current->buf_size;
+  uint64_t free_space = current->capacity - current->buf_size;
+
+  va_list args;
+  va_start(args, fmt);
+  int req_length = vsnprintf(buf, free_space, fmt, args);
+  va_end(args);
+  if (req_length < 0) {
+    return_bad(str_err, STR_EMPTY, "Error in format string");
+  }
+
+  if ((uint64_t)req_length < free_space) {
+    current->buf_size += req_length; // the '\0' is left outside of the allocation.
+  } else {
+    buf = arena_alloc(arena, req_length + 1);
+    if (buf == NULL) {
+      return_halt(str_err, STR_EMPTY, "formatted string doesn't fit in the arena");
+    }
+    va_start(args, fmt);
+    vsnprintf(buf, req_length + 1, fmt, args);
+    va_end(args);
+  }
+
+  String composed = {
+    .str = buf,
+    .capacity = req_length,
+    .length = req_length,
+    .offset = 0,
+    .mutable = false,
+  };
+  return_ok(str_err, composed);
+}
+
 // Returns the index of the first occurrence of `key` after `start` within
 // `src`, or BAD if `key` is not found.
 int64_t str_contains(const String* src, int64_t start, const char* key, uint64_t key_len) {
   int pos;
-  for (int i = start; i < src->length; i++) {
+  for (int64_t i = start; i + key_len <= src->length; i++) {
     for (pos = 0; pos < key_len && src->str[i + pos] == key[pos]; pos++);
     if (pos == key_len) {
       return_ok(str_err, i);
@@ -489,19 +901,23 @@ double str_to_double(const String* s) {
 // Returns the index after the replacement on success, BAD on error (non-mutable slice or invalid start index),
 // or if the key is not found, HALT on memory allocation failure.
 int str_replace_first(String* s, int start, const char* search_key, uint32_t key_len, const char* target, uint32_t target_len) {
+  TRACE_LIB_FUNC();
   if (!s->mutable) {
     return_halt(str_err, HALT, "Illegal action. Cannot modify a slice");
   }
   if (start < 0 || start >= s->length) {
     return_bad(str_err, BAD, "invalid start index");    
   }
-  if (str_cmp(&(String){(char*)search_key, key_len, key_len}, &(String){(char*)target, target_len, target_len}) == 0) {
+  if (str_eq(&(String){(char*)search_key, key_len, key_len}, &(String){(char*)target, target_len, target_len})) {
     return_ok(str_err, OK); // no need of replacement if key and value are same. just return.
   }
   int64_t span_start = str_contains(s, start, search_key, key_len);
   if (span_start == BAD) { // return if key is not present in s
     return_bad(str_err, BAD, "key is not present in s");
   }
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
 
   uint32_t span_end = span_start + key_len - 1;
   int32_t diff = key_len - target_len;
@@ -512,15 +928,12 @@ int str_replace_first(String* s, int start, const char* search_key, uint32_t key
     }
   } else if (diff < 0) { // target string is longer than search_key
     diff *= -1;
-    if (s->length + diff > s->capacity) {
-      int8_t ret = str_scale(s, 1.0 + _STR_SCALE_FACTOR);
-      if (ret == BAD) return_bad(str_err, ret, "malloc failure.");
-      else if (ret == HALT) return_halt(str_err, ret, "malloc failure.");
-      s->length += diff;
-      for (int j = s->length - 1; j >= span_end; j--) {
-        s->str[j + diff] = s->str[j];
-      } 
+    if (_str_grow(s, s->offset + s->length + diff) != OK) {
+      return_halt(str_err, HALT, "malloc failure.");
     }
+    // shift characters after the key to the right
+    memmove(s->str + span_end + 1 + diff, s->str + span_end + 1, s->length - span_end - 1);
+    s->length += diff;
   }
   for (int i = span_start, j = 0; j < target_len; i++, j++) {
     s->str[i] = target[j];
@@ -530,29 +943,30 @@ int str_replace_first(String* s, int start, const char* search_key, uint32_t key
 
 // Replaces all occurrences of `key` with `replace_with`.
 int8_t str_replace_all(String* s, const char* search_key, uint32_t key_len, const char* target, uint32_t target_len) {
+  TRACE_LIB_FUNC();
   if (!s->mutable) {
     return_halt(str_err, HALT, "Illegal action. Cannot modify a slice");
   }
 
-  if (str_cmp(&(String){(char*)search_key, key_len, key_len}, &(String){(char*)target, target_len, target_len}) == 0) {
+  if (str_eq(&(String){(char*)search_key, key_len, key_len}, &(String){(char*)target, target_len, target_len})) {
     return_ok(str_err, OK); // no need of replacement if key and value are same. just return.
   }
 
   int64_t select_start = str_contains(s, 0, search_key, key_len);
+  if (select_start != BAD && _str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
   int select_end = 0;
   int diff = target_len - key_len;
   while (select_start != BAD) {
     select_end = select_start + key_len - 1;
     if (diff > 0) {
-      if (s->capacity - s->length <= diff) {
-        int8_t ret = str_scale(s, _STR_SCALE_FACTOR);
-        if (ret == BAD) return_bad(str_err, ret, "malloc failure.");
-        else if (ret == HALT) return_halt(str_err, ret, "malloc failure.");
+      if (_str_grow(s, s->offset + s->length + diff) != OK) {
+        return_halt(str_err, HALT, "malloc failure.");
       }
+      // right shift the characters after the key
+      memmove(s->str + select_end + 1 + diff, s->str + select_end + 1, s->length - select_end - 1);
       s->length += diff;
-      for (uint64_t j = s->length - 1; j >= select_end; j--) {
-        s->str[j + diff] = s->str[j]; // right shift
-      } 
     } else if (diff < 0) {
       diff *= -1;
       s->length -= diff;
@@ -570,6 +984,9 @@ int8_t str_replace_all(String* s, const char* search_key, uint32_t key_len, cons
 }
 
 int8_t str_to_upper(String* s) {
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
   for (uint64_t i = 0; i <  s->length; i++) {
     if (s->str[i] >= 'a' && s->str[i] <= 'z') {
       s->str[i] = 'A' +  s->str[i] - 'a';
@@ -579,6 +996,9 @@ int8_t str_to_upper(String* s) {
 }
 
 int8_t str_to_lower(String* s) {
+  if (_str_unshare(s, s->capacity) != OK) {
+    return_halt(str_err, HALT, "failed to unshare s");
+  }
   for (uint64_t i = 0; i <  s->length; i++) {
     if (s->str[i] >= 'A' && s->str[i] <= 'Z') {
       s->str[i] = 'a' +  s->str[i] - 'A';
@@ -603,8 +1023,14 @@ char*  str_to_cstring(const String* s) {
 }
 
 // Frees the memory allocated for the string and resets metadata.
+// For a shared string only this reference is dropped; the buffer is freed with the last one.
 void str_free(String* s) {
-  free(s->str - s->offset);
+  TRACE_LIB_FUNC();
+  if (s->shared) {
+    if (__atomic_sub_fetch(&_str_header(s)->refs, 1, __ATOMIC_ACQ_REL) == 0) free(_str_header(s));
+  } else {
+    free(s->str - s->offset);
+  }
   *s = STR_EMPTY;
 }
 
@@ -0,0 +1,364 @@
+/*
+ * StrVec is a compact table of strings for when there are millions of them.
+ *
+ * Instead of one String struct and one malloc() per string, all the bytes
+ * live back to back in a single blob, and string i is the span
+ * [offsets[i], offsets[i + 1]) of it. Offsets are stored as uint32_t and are
+ * widened to uint64_t in place once the blob outgrows 4 GiB, so a small
+ * table costs 4 bytes per string on top of its contents.
+ *
+ * A StrVec can be saved to a file and mapped back with mmap() without any
+ * parsing. The file layout is a 32 byte header (magic, count, blob length,
+ * offset width), the offsets, padding up to 8 bytes and the blob, all in
+ * native byte order. A mapped StrVec is read-only.
+ *
+ * Strings returned by strvec_get() are non-mutable slices into the blob.
+ * They are invalidated by the next push or sort, just like pointers into a
+ * vector.
+ *
+ * Date: October-19-2026
+ *
+ * ## HOW TO USE ##
+ * StrVec strvec_init(uint64_t count, uint64_t blob_capacity)
+ *   -- Initializes an empty table with room for `count` strings and
+ *      `blob_capacity` bytes. Both may be 0 (STR_DYNAMIC).
+ *
+ * int8_t strvec_push(StrVec *v, const char *str, uint64_t len)
+ *   -- Appends a copy of `len` bytes of `str`.
+ *
+ * String strvec_get(const StrVec *v, uint64_t i)
+ *   -- Returns string `i` as a non-mutable slice.
+ *
+ * StrVec strvec_split(const String *s, const char *delim, uint64_t delim_len)
+ *   -- Builds a table out of the pieces of `s` between the delimiters.
+ *
+ * int8_t strvec_sort(StrVec *v, bool dedup)
+ *   -- Sorts the strings in str_cmp() order, removing duplicates if asked.
+ *
+ * int8_t strvec_save(const StrVec *v, const char *filename)
+ * StrVec strvec_map(const char *filename)
+ *   -- Saves a table to a file / maps a saved table back read-only.
+ *
+ * void strvec_free(StrVec *v)
+ *   -- Releases the table, unmapping it if it was mapped.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "strings.c"
+
+#include "err.c"
+_Thread_local signed char strvec_err[ERR_BUF_SIZE];
+
+#define STRVEC_EMPTY ((StrVec) {0})
+#define _STRVEC_MAGIC "STRVEC01"
+
+typedef struct {
+  char* blob;             // contents of every string, back to back
+  uint64_t blob_length;
+  uint64_t blob_capacity;
+  void* offsets;          // count + 1 offsets into blob, uint32_t or uint64_t
+  uint64_t count;
+  uint64_t offsets_capacity; // in number of offsets
+  bool wide;              // offsets are uint64_t
+  void* map;              // start of the mapping if the table was mapped from a file
+  uint64_t map_length;
+} StrVec;
+
+// header of a saved StrVec.
+typedef struct {
+  char magic[8];
+  uint64_t count;
+  uint64_t blob_length;
+  uint64_t wide;
+} _StrVecHeader;
+
+static inline uint64_t _strvec_offset(const StrVec* v, uint64_t i) {
+  return v->wide ? ((uint64_t*)v->offsets)[i] : ((uint32_t*)v->offsets)[i];
+}
+
+static inline void _strvec_set_offset(StrVec* v, uint64_t i, uint64_t offset) {
+  if (v->wide) ((uint64_t*)v->offsets)[i] = offset;
+  else ((uint32_t*)v->offsets)[i] = offset;
+}
+
+// Initializes an empty table with room for `count` strings and
+// `blob_capacity` bytes of contents. Both may be STR_DYNAMIC.
+// Returns STRVEC_EMPTY on failure.
+StrVec strvec_init(uint64_t count, uint64_t blob_capacity) {
+  StrVec v = STRVEC_EMPTY;
+  v.offsets_capacity = (count > 0) ? count + 1 : 16;
+  v.blob_capacity = (blob_capacity > 0) ? blob_capacity : 64;
+  v.offsets = malloc(sizeof(uint32_t) * v.offsets_capacity);
+  v.blob = malloc(v.blob_capacity);
+  if (v.offsets == NULL || v.blob == NULL) {
+    free(v.offsets);
+    free(v.blob);
+    return_halt(strvec_err, STRVEC_EMPTY, "malloc() failed");
+  }
+  ((uint32_t*)v.offsets)[0] = 0;
+  return_ok(strvec_err, v);
+}
+
+// switches the offsets from uint32_t to uint64_t, converting from the back.
+static int8_t _strvec_widen(StrVec* v) {
+  uint64_t* tmp = realloc(v->offsets, sizeof(uint64_t) * v->offsets_capacity);
+  if (tmp == NULL) return HALT;
+  uint32_t* narrow = (uint32_t*)tmp;
+  for (uint64_t i = v->count + 1; i-- > 0;) tmp[i] = narrow[i];
+  v->offsets = tmp;
+  v->wide = true;
+  return OK;
+}
+
+// Appends a copy of `len` bytes of `str` to the table. `str` may point into the table itself.
+// Returns OK on success, HALT on a mapped table or on memory allocation failure.
+int8_t strvec_push(StrVec* v, const char* str, uint64_t len) {
+  if (v->map != NULL) {
+    return_halt(strvec_err, HALT, "Illegal action. Can't modify a mapped StrVec");
+  }
+  if (!v->wide && v->blob_length + len > UINT32_MAX && _strvec_widen(v) != OK) {
+    return_halt(strvec_err, HALT, "failed to widen offsets");
+  }
+  if (v->count + 2 > v->offsets_capacity) {
+    // STRVEC_EMPTY has no offsets yet, not even the leading 0.
+    bool first = v->offsets == NULL;
+    uint64_t capacity = (v->offsets_capacity * 2 > 2) ? v->offsets_capacity * 2 : 2;
+    void* tmp = realloc(v->offsets, (v->wide ? sizeof(uint64_t) : sizeof(uint32_t)) * capacity);
+    if (tmp == NULL) {
+      return_halt(strvec_err, HALT, "realloc() failed");
+    }
+    v->offsets = tmp;
+    v->offsets_capacity = capacity;
+    if (first) _strvec_set_offset(v, 0, 0);
+  }
+  // remember where `str` is if it lives in the blob that may move.
+  uintptr_t base = (uintptr_t)v->blob;
+  bool inside = v->blob != NULL && (uintptr_t)str >= base && (uintptr_t)str < base + v->blob_capacity;
+  uint64_t rel = (uintptr_t)str - base;
+  if (v->blob_length + len > v->blob_capacity) {
+    uint64_t capacity = v->blob_capacity * 2;
+    if (capacity < v->blob_length + len) capacity = v->blob_length + len;
+    char* tmp = realloc(v->blob, capacity);
+    if (tmp == NULL) {
+      return_halt(strvec_err, HALT, "realloc() failed");
+    }
+    v->blob = tmp;
+    v->blob_capacity = capacity;
+  }
+  if (inside) str = v->blob + rel;
+  if (len > 0) memcpy(v->blob + v->blob_length, str, len);
+  v->blob_length += len;
+  v->count++;
+  _strvec_set_offset(v, v->count, v->blob_length);
+  return_ok(strvec_err, OK);
+}
+
+// Releases the table and resets it to STRVEC_EMPTY.
+void strvec_free(StrVec* v) {
+  if (v->map != NULL) {
+    munmap(v->map, v->map_length);
+  } else {
+    free(v->blob);
+    free(v->offsets);
+  }
+  *v = STRVEC_EMPTY;
+}
+
+// Returns string `i` of the table as a non-mutable slice into the blob.
+// Returns STR_EMPTY if `i` is out of range.
+String strvec_get(const StrVec* v, uint64_t i) {
+  if (i >= v->count) {
+    return_bad(strvec_err, STR_EMPTY, "index out of range");
+  }
+  uint64_t start = _strvec_offset(v, i);
+  String s = {
+    .str = v->blob + start,
+    .capacity = _strvec_offset(v, i + 1) - start,
+    .length = _strvec_offset(v, i + 1) - start,
+    .offset = 0,
+    .mutable = false,
+  };
+  return_ok(strvec_err, s);
+}
+
+// Builds a table out of the pieces of `s` separated by `delim`.
+// Empty pieces between adjacent delimiters are kept. The blob is sized
+// once for the whole of `s`.
+// Returns STRVEC_EMPTY on failure.
+StrVec strvec_split(const String* s, const char* delim, uint64_t delim_len) {
+  if (delim_len == 0) {
+    return_bad(strvec_err, STRVEC_EMPTY, "delimiter must not be empty");
+  }
+  StrVec v = strvec_init(STR_DYNAMIC, s->length);
+  if (v.blob == NULL) {
+    return_halt(strvec_err, STRVEC_EMPTY, "failed to allocate the table");
+  }
+  const char* cursor = s->str;
+  const char* end = s->str + s->length;
+  while (true) {
+    const char* found = (delim_len == 1)
+      ? memchr(cursor, delim[0], end - cursor)
+      : memmem(cursor, end - cursor, delim, delim_len);
+    const char* piece_end = (found != NULL) ? found : end;
+    if (strvec_push(&v, cursor, piece_end - cursor) != OK) {
+      strvec_free(&v);
+      return_halt(strvec_err, STRVEC_EMPTY, "failed to push a piece");
+    }
+    if (found == NULL) break;
+    cursor = found + delim_len;
+  }
+  return_ok(strvec_err, v);
+}
+
+// Sorts the table in str_cmp() order and, if `dedup` is set, keeps only
+// the first of every run of equal strings. Strings are spans between
+// consecutive offsets, so the blob is rebuilt in sorted order rather than
+// permuted in place; neighbouring strings also stay next to each other in
+// memory that way. On top of the new blob and offsets this takes 64 bytes
+// per string while sorting and 32 bytes per string while copying.
+// Returns OK on success, HALT on a mapped table or on memory allocation failure.
+int8_t strvec_sort(StrVec* v, bool dedup) {
+  if (v->map != NULL) {
+    return_halt(strvec_err, HALT, "Illegal action. Can't modify a mapped StrVec");
+  }
+  if (v->count < 2) return_ok(strvec_err, OK);
+  _StrSortItem* items = malloc(sizeof(_StrSortItem) * v->count);
+  _StrSortItem* tmp = malloc(sizeof(_StrSortItem) * v->count);
+  if (items == NULL || tmp == NULL) {
+    free(items);
+    free(tmp);
+    return_halt(strvec_err, HALT, "malloc() failed");
+  }
+  for (uint64_t i = 0; i < v->count; i++) {
+    uint64_t start = _strvec_offset(v, i);
+    items[i] = (_StrSortItem) { .str = v->blob + start, .length = _strvec_offset(v, i + 1) - start, .idx = i };
+  }
+  _str_sort_items(items, tmp, v->count);
+  free(tmp);
+
+  uint64_t count = v->count, blob_length = v->blob_length;
+  if (dedup) {
+    count = 1;
+    blob_length = items[0].length;
+    for (uint64_t i = 1; i < v->count; i++) {
+      const _StrSortItem* last = &items[count - 1];
+      if (items[i].length == last->length && memcmp(items[i].str, last->str, last->length) == 0) continue;
+      items[count++] = items[i];
+      blob_length += items[i].length;
+    }
+  }
+  bool wide = blob_length > UINT32_MAX;
+  void* offsets = malloc((count + 1) * (wide ? sizeof(uint64_t) : sizeof(uint32_t)));
+  char* blob = malloc(blob_length > 0 ? blob_length : 1);
+  if (offsets == NULL || blob == NULL) {
+    free(items);
+    free(offsets);
+    free(blob);
+    return_halt(strvec_err, HALT, "failed to allocate the sorted table");
+  }
+  StrVec sorted = {
+    .blob = blob,
+    .blob_capacity = blob_length > 0 ? blob_length : 1,
+    .offsets = offsets,
+    .offsets_capacity = count + 1,
+    .count = count,
+    .wide = wide,
+  };
+  _strvec_set_offset(&sorted, 0, 0);
+  for (uint64_t i = 0; i < count; i++) {
+    if (items[i].length > 0) memcpy(blob + sorted.blob_length, items[i].str, items[i].length);
+    sorted.blob_length += items[i].length;
+    _strvec_set_offset(&sorted, i + 1, sorted.blob_length);
+  }
+  free(items);
+  strvec_free(v);
+  *v = sorted;
+  return_ok(strvec_err, OK);
+}
+
+static uint64_t _strvec_offsets_size(uint64_t count, bool wide) {
+  uint64_t size = (count + 1) * (wide ? sizeof(uint64_t) : sizeof(uint32_t));
+  return (size + 7) & ~7ULL; // the blob starts 8 byte aligned
+}
+
+// Saves the table to `filename` in a layout that strvec_map() can use directly.
+// Returns OK on success, HALT if the file can't be written.
+int8_t strvec_save(const StrVec* v, const char* filename) {
+  FILE* fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return_halt(strvec_err, HALT, "failed to open file");
+  }
+  _StrVecHeader header = { .count = v->count, .blob_length = v->blob_length, .wide = v->wide };
+  memcpy(header.magic, _STRVEC_MAGIC, sizeof(header.magic));
+  uint64_t offsets_bytes = (v->count + 1) * (v->wide ? sizeof(uint64_t) : sizeof(uint32_t));
+  uint64_t padding = _strvec_offsets_size(v->count, v->wide) - offsets_bytes;
+  const char zeros[8] = {0};
+  // a table that was never initialized (STRVEC_EMPTY) has no offsets: its only offset is 0.
+  const void* offsets = (v->offsets != NULL) ? v->offsets : zeros;
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+    && fwrite(offsets, 1, offsets_bytes, fp) == offsets_bytes
+    && fwrite(zeros, 1, padding, fp) == padding
+    && (v->blob_length == 0 || fwrite(v->blob, 1, v->blob_length, fp) == v->blob_length);
+  if (fclose(fp) != 0) ok = false;
+  if (!ok) {
+    return_halt(strvec_err, HALT, "couldn't finish writing to file");
+  }
+  return_ok(strvec_err, OK);
+}
+
+// Maps a table saved by strvec_save() back into memory, read-only.
+// Nothing is parsed or copied; pages are loaded as the strings are used.
+// Returns STRVEC_EMPTY on failure.
+StrVec strvec_map(const char* filename) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return_halt(strvec_err, STRVEC_EMPTY, "failed to open file");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(_StrVecHeader)) {
+    close(fd);
+    return_bad(strvec_err, STRVEC_EMPTY, "file is too small to be a StrVec");
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return_halt(strvec_err, STRVEC_EMPTY, "mmap() failed");
+  }
+
+  const _StrVecHeader* header = map;
+  uint64_t offsets_size = _strvec_offsets_size(header->count, header->wide);
+  if (memcmp(header->magic, _STRVEC_MAGIC, sizeof(header->magic)) != 0
+      || header->count > (uint64_t)st.st_size
+      || sizeof(_StrVecHeader) + offsets_size + header->blob_length != (uint64_t)st.st_size) {
+    munmap(map, st.st_size);
+    return_bad(strvec_err, STRVEC_EMPTY, "file is not a valid StrVec");
+  }
+  StrVec v = {
+    .count = header->count,
+    .wide = header->wide,
+    .offsets = (char*)map + sizeof(_StrVecHeader),
+    .offsets_capacity = header->count + 1,
+    .blob = (char*)map + sizeof(_StrVecHeader) + offsets_size,
+    .blob_length = header->blob_length,
+    .blob_capacity = header->blob_length,
+    .map = map,
+    .map_length = st.st_size,
+  };
+  if (_strvec_offset(&v, v.count) != v.blob_length) {
+    munmap(map, st.st_size);
+    return_bad(strvec_err, STRVEC_EMPTY, "file is not a valid StrVec");
+  }
+  return_ok(strvec_err, v);
+}
+
+// shorthand of strvec_push() using String types.
+#define sstrvec_push(vec_ptr, str_ptr) strvec_push(vec_ptr, (str_ptr)->str, (str_ptr)->length)
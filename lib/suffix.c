@@ -0,0 +1,490 @@
+/*
+ * SuffixIndex answers substring queries on a large String in O(m log n)
+ * instead of scanning it like str_contains() does.
+ *
+ * It is a suffix array (the start of every suffix of the text, in sorted
+ * order) built in O(n) with SA-IS, plus the LCP array (length of the common
+ * prefix of each suffix and the one before it) computed with Kasai's
+ * algorithm. Occurrences of a key are a contiguous range of the suffix
+ * array, found with two binary searches.
+ *
+ * Positions are stored as int32_t, so a text can be at most INT32_MAX
+ * bytes long. A built index costs 8 bytes per byte of text, allocated
+ * from the given Arena; it refers to the text instead of copying it, so
+ * the text must outlive the index and must not be modified.
+ *
+ * An index can be saved to a file together with its text and mapped back
+ * with mmap() without any parsing. The file layout is a 32 byte header
+ * (magic, length), the suffix array, the LCP array and the text, in native
+ * byte order. A mapped index is read-only and self-contained.
+ *
+ * Date: October-19-2026
+ *
+ * ## HOW TO USE ##
+ * SuffixIndex suffix_build(Arena *arena, const String *text, uint32_t threads)
+ *   -- Indexes `text`. `threads` workers compute the LCP array;
+ *      0 uses one per online cpu.
+ *
+ * bool suffix_exists(const SuffixIndex *idx, const char *key, uint64_t key_len)
+ * uint64_t suffix_count(const SuffixIndex *idx, const char *key, uint64_t key_len)
+ *   -- Whether / how many times `key` occurs in the text.
+ *
+ * uint64_t suffix_positions(const SuffixIndex *idx, const char *key, uint64_t key_len,
+ *                           int32_t *positions, uint64_t max)
+ *   -- Writes up to `max` starting positions of `key` and returns how many there are.
+ *
+ * String suffix_longest_repeat(const SuffixIndex *idx)
+ *   -- The longest substring occurring at least twice.
+ *
+ * int8_t suffix_save(const SuffixIndex *idx, const char *filename)
+ * SuffixIndex suffix_map(const char *filename)
+ *   -- Saves an index with its text / maps a saved index back read-only.
+ *
+ * void suffix_free(SuffixIndex *idx)
+ *   -- Unmaps a mapped index. A built one lives in its Arena.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "strings.c"
+#include "arena.c"
+#include "trace.c"
+
+#include "err.c"
+_Thread_local signed char suffix_err[ERR_BUF_SIZE];
+
+#define SUFFIX_EMPTY ((SuffixIndex) {0})
+#define _SUFFIX_MAGIC "SUFFIX01"
+
+#ifndef SUFFIX_PARALLEL_MIN
+#define SUFFIX_PARALLEL_MIN (1 << 20) // texts shorter than this are indexed on the calling thread.
+#endif
+
+typedef struct {
+  String text;     // the indexed bytes, non-mutable. not owned by the index.
+  int32_t* sa;     // start of every suffix, in sorted order
+  int32_t* lcp;    // lcp[i]: common prefix length of suffixes sa[i - 1] and sa[i]. lcp[0] = 0
+  void* map;       // start of the mapping if the index was mapped from a file
+  uint64_t map_length;
+} SuffixIndex;
+
+// header of a saved SuffixIndex.
+typedef struct {
+  char magic[8];
+  uint64_t length;
+  uint64_t _reserved[2];
+} _SuffixHeader;
+
+/*
+ * SA-IS. `s` holds n symbols in [0, upper]; the sorted suffixes are written
+ * to `sa`. Suffixes are classified as S (smaller than the next one) or L
+ * (larger). Leftmost S suffixes (LMS) are sorted first, by naming the LMS
+ * substrings and recursing when names repeat; every other suffix is then
+ * induced from them in two passes over the buckets.
+ */
+
+typedef struct {
+  const int32_t* s;
+  int32_t n;
+  const uint8_t* ls;    // 1 for S suffixes
+  const int32_t* sum_l; // start of the L part of every bucket
+  const int32_t* sum_s; // start of the S part of every bucket
+  int32_t* buf;         // bucket cursors, upper + 1
+  int32_t* sa;
+  int32_t upper;
+} _SaisState;
+
+static void _sais_induce(_SaisState* st, const int32_t* lms, int32_t m) {
+  const int32_t* s = st->s;
+  int32_t n = st->n;
+  int32_t* sa = st->sa;
+  int32_t* buf = st->buf;
+  uint64_t buckets = sizeof(int32_t) * (st->upper + 1);
+
+  for (int32_t i = 0; i < n; i++) sa[i] = -1;
+  memcpy(buf, st->sum_s, buckets);
+  for (int32_t i = 0; i < m; i++) {
+    if (lms[i] == n) continue;
+    sa[buf[s[lms[i]]]++] = lms[i];
+  }
+  memcpy(buf, st->sum_l, buckets);
+  sa[buf[s[n - 1]]++] = n - 1;
+  for (int32_t i = 0; i < n; i++) {
+    int32_t v = sa[i];
+    if (v >= 1 && !st->ls[v - 1]) sa[buf[s[v - 1]]++] = v - 1;
+  }
+  memcpy(buf, st->sum_l, buckets);
+  for (int32_t i = n - 1; i >= 0; i--) {
+    int32_t v = sa[i];
+    if (v >= 1 && st->ls[v - 1]) sa[--buf[s[v - 1] + 1]] = v - 1;
+  }
+}
+
+// Returns OK on success, HALT on memory allocation failure.
+static int8_t _sais(const int32_t* s, int32_t n, int32_t upper, int32_t* sa) {
+  if (n == 0) return OK;
+  if (n == 1) {
+    sa[0] = 0;
+    return OK;
+  }
+  if (n == 2) {
+    sa[0] = (s[0] < s[1]) ? 0 : 1;
+    sa[1] = 1 - sa[0];
+    return OK;
+  }
+
+  int8_t status = HALT;
+  uint8_t* ls = calloc(n, sizeof(uint8_t));
+  int32_t* sum_l = calloc(upper + 2, sizeof(int32_t));
+  int32_t* sum_s = calloc(upper + 2, sizeof(int32_t));
+  int32_t* buf = malloc(sizeof(int32_t) * (upper + 2));
+  int32_t* lms_map = malloc(sizeof(int32_t) * (n + 1));
+  int32_t* lms = calloc(n / 2 + 1, sizeof(int32_t));
+  int32_t *sorted_lms = NULL, *rec_s = NULL, *rec_sa = NULL;
+  if (ls == NULL || sum_l == NULL || sum_s == NULL || buf == NULL || lms_map == NULL || lms == NULL) goto done;
+
+  for (int32_t i = n - 2; i >= 0; i--) {
+    ls[i] = (s[i] == s[i + 1]) ? ls[i + 1] : (s[i] < s[i + 1]);
+  }
+  for (int32_t i = 0; i < n; i++) {
+    if (!ls[i]) sum_s[s[i]]++;
+    else sum_l[s[i] + 1]++;
+  }
+  for (int32_t i = 0; i <= upper; i++) {
+    sum_s[i] += sum_l[i];
+    if (i < upper) sum_l[i + 1] += sum_s[i];
+  }
+
+  int32_t m = 0;
+  for (int32_t i = 0; i <= n; i++) lms_map[i] = -1;
+  for (int32_t i = 1; i < n; i++) {
+    if (!ls[i - 1] && ls[i]) {
+      lms_map[i] = m;
+      lms[m++] = i;
+    }
+  }
+  _SaisState st = { s, n, ls, sum_l, sum_s, buf, sa, upper };
+  _sais_induce(&st, lms, m);
+
+  if (m > 0) {
+    // name the LMS substrings in sorted order. equal substrings share a name.
+    sorted_lms = malloc(sizeof(int32_t) * m);
+    rec_s = malloc(sizeof(int32_t) * m);
+    rec_sa = malloc(sizeof(int32_t) * m);
+    if (sorted_lms == NULL || rec_s == NULL || rec_sa == NULL) goto done;
+    int32_t k = 0;
+    for (int32_t i = 0; i < n; i++) {
+      if (lms_map[sa[i]] != -1) sorted_lms[k++] = sa[i];
+    }
+    int32_t rec_upper = 0;
+    rec_s[lms_map[sorted_lms[0]]] = 0;
+    for (int32_t i = 1; i < m; i++) {
+      int32_t l = sorted_lms[i - 1], r = sorted_lms[i];
+      int32_t end_l = (lms_map[l] + 1 < m) ? lms[lms_map[l] + 1] : n;
+      int32_t end_r = (lms_map[r] + 1 < m) ? lms[lms_map[r] + 1] : n;
+      bool same = true;
+      if (end_l - l != end_r - r) {
+        same = false;
+      } else {
+        while (l < end_l && s[l] == s[r]) {
+          l++;
+          r++;
+        }
+        if (l == n || s[l] != s[r]) same = false;
+      }
+      if (!same) rec_upper++;
+      rec_s[lms_map[sorted_lms[i]]] = rec_upper;
+    }
+    if (_sais(rec_s, m, rec_upper, rec_sa) != OK) goto done;
+    for (int32_t i = 0; i < m; i++) sorted_lms[i] = lms[rec_sa[i]];
+    _sais_induce(&st, sorted_lms, m);
+  }
+  status = OK;
+
+done:
+  free(ls);
+  free(sum_l);
+  free(sum_s);
+  free(buf);
+  free(lms_map);
+  free(lms);
+  free(sorted_lms);
+  free(rec_s);
+  free(rec_sa);
+  return status;
+}
+
+/*
+ * Kasai's LCP, split across threads. Each worker walks its own range of text
+ * positions; the carried-over match length just starts from 0 at the start
+ * of a range, which costs at most one extra longest-match per worker.
+ */
+
+typedef struct {
+  const char* text;
+  int32_t n;
+  const int32_t* sa;
+  int32_t* rank;
+  int32_t* lcp;
+  int32_t from, to;
+} _SuffixJob;
+
+static void* _suffix_rank_worker(void* arg) {
+  _SuffixJob* job = arg;
+  for (int32_t i = job->from; i < job->to; i++) job->rank[job->sa[i]] = i;
+  return NULL;
+}
+
+static void* _suffix_lcp_worker(void* arg) {
+  _SuffixJob* job = arg;
+  const char* text = job->text;
+  int32_t h = 0;
+  for (int32_t i = job->from; i < job->to; i++) {
+    if (h > 0) h--;
+    int32_t r = job->rank[i];
+    if (r == 0) {
+      job->lcp[0] = 0;
+      h = 0;
+      continue;
+    }
+    int32_t j = job->sa[r - 1];
+    while (i + h < job->n && j + h < job->n && text[i + h] == text[j + h]) h++;
+    job->lcp[r] = h;
+  }
+  return NULL;
+}
+
+// runs `worker` over [0, n) split into `threads` ranges. ranges whose thread
+// can't be started run on the calling thread.
+static void _suffix_parallel(_SuffixJob* jobs, uint32_t threads, void* (*worker)(void*)) {
+  pthread_t tids[threads];
+  bool started[threads];
+  for (uint32_t t = 1; t < threads; t++) {
+    started[t] = pthread_create(&tids[t], NULL, worker, &jobs[t]) == 0;
+  }
+  worker(&jobs[0]);
+  for (uint32_t t = 1; t < threads; t++) {
+    if (started[t]) pthread_join(tids[t], NULL);
+    else worker(&jobs[t]);
+  }
+}
+
+// Builds a suffix index over `text`, which must outlive the index unchanged.
+// The suffix and LCP arrays (8 bytes per byte of text) are allocated from
+// `arena`, scratch memory is malloc()ed and released. `threads` workers
+// compute the LCP array; 0 uses one per online cpu.
+// Returns SUFFIX_EMPTY on failure.
+SuffixIndex suffix_build(Arena* arena, const String* text, uint32_t threads) {
+  TRACE_LIB_FUNC();
+  if (text->length > INT32_MAX) {
+    return_bad(suffix_err, SUFFIX_EMPTY, "text is too long to be indexed");
+  }
+  int32_t n = text->length;
+  SuffixIndex idx = SUFFIX_EMPTY;
+  idx.text = (String) {
+    .str = text->str,
+    .length = text->length,
+    .capacity = text->length,
+    .offset = 0,
+    .mutable = false,
+  };
+  if (n == 0) return_ok(suffix_err, idx);
+
+  idx.sa = arena_alloc_aligned(arena, sizeof(int32_t) * n, sizeof(int32_t));
+  idx.lcp = arena_alloc_aligned(arena, sizeof(int32_t) * n, sizeof(int32_t));
+  if (idx.sa == NULL || idx.lcp == NULL) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "failed to allocate the index from the arena");
+  }
+
+  // SA-IS works on int32_t symbols: the bytes of the text, as unsigned.
+  int32_t* symbols = malloc(sizeof(int32_t) * n);
+  if (symbols == NULL) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "malloc() failed");
+  }
+  for (int32_t i = 0; i < n; i++) symbols[i] = (uint8_t)text->str[i];
+  int8_t status = _sais(symbols, n, UINT8_MAX, idx.sa);
+  free(symbols);
+  if (status != OK) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "failed to sort the suffixes");
+  }
+
+  int32_t* rank = malloc(sizeof(int32_t) * n);
+  if (rank == NULL) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "malloc() failed");
+  }
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (cpus > 0) ? cpus : 1;
+  }
+  if (n < SUFFIX_PARALLEL_MIN) threads = 1;
+  if (threads > 64) threads = 64;
+  _SuffixJob jobs[threads];
+  for (uint32_t t = 0; t < threads; t++) {
+    jobs[t] = (_SuffixJob) {
+      .text = text->str, .n = n, .sa = idx.sa, .rank = rank, .lcp = idx.lcp,
+      .from = (int64_t)n * t / threads, .to = (int64_t)n * (t + 1) / threads,
+    };
+  }
+  _suffix_parallel(jobs, threads, _suffix_rank_worker);
+  _suffix_parallel(jobs, threads, _suffix_lcp_worker);
+  free(rank);
+  return_ok(suffix_err, idx);
+}
+
+// Compares the suffix at `pos` with `key`, looking at no more than `key_len` bytes.
+// Returns 0 if `key` is a prefix of the suffix.
+static int _suffix_cmp(const SuffixIndex* idx, int32_t pos, const char* key, uint64_t key_len) {
+  uint64_t rest = idx->text.length - pos;
+  int diff = memcmp(idx->text.str + pos, key, (rest < key_len) ? rest : key_len);
+  if (diff != 0) return diff;
+  return (rest < key_len) ? -1 : 0;
+}
+
+// Returns the range [*first, *last) of the suffix array holding the suffixes that start with `key`.
+static void _suffix_range(const SuffixIndex* idx, const char* key, uint64_t key_len, uint64_t* first, uint64_t* last) {
+  uint64_t lo = 0, hi = idx->text.length;
+  while (lo < hi) { // first suffix >= key
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (_suffix_cmp(idx, idx->sa[mid], key, key_len) < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  *first = lo;
+  hi = idx->text.length;
+  while (lo < hi) { // first suffix that doesn't start with key
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (_suffix_cmp(idx, idx->sa[mid], key, key_len) <= 0) lo = mid + 1;
+    else hi = mid;
+  }
+  *last = lo;
+}
+
+// Returns true if `key` occurs in the indexed text.
+bool suffix_exists(const SuffixIndex* idx, const char* key, uint64_t key_len) {
+  uint64_t first, last;
+  _suffix_range(idx, key, key_len, &first, &last);
+  return_ok(suffix_err, first < last);
+}
+
+// Returns the number of (possibly overlapping) occurrences of `key` in the indexed text.
+uint64_t suffix_count(const SuffixIndex* idx, const char* key, uint64_t key_len) {
+  uint64_t first, last;
+  _suffix_range(idx, key, key_len, &first, &last);
+  return_ok(suffix_err, last - first);
+}
+
+// Writes the starting positions of up to `max` occurrences of `key` to
+// `positions`, in suffix order rather than text order.
+// Returns the number of occurrences, which may be more than `max`.
+uint64_t suffix_positions(const SuffixIndex* idx, const char* key, uint64_t key_len, int32_t* positions, uint64_t max) {
+  uint64_t first, last;
+  _suffix_range(idx, key, key_len, &first, &last);
+  uint64_t n = (last - first < max) ? last - first : max;
+  if (n > 0) memcpy(positions, idx->sa + first, sizeof(int32_t) * n);
+  return_ok(suffix_err, last - first);
+}
+
+// Returns the longest substring that occurs at least twice in the indexed text,
+// as a non-mutable slice of it. Returns an empty slice if no byte repeats.
+String suffix_longest_repeat(const SuffixIndex* idx) {
+  uint64_t best = 0;
+  for (uint64_t i = 1; i < idx->text.length; i++) {
+    if (idx->lcp[i] > idx->lcp[best]) best = i;
+  }
+  int32_t pos = (idx->text.length > 0) ? idx->sa[best] : 0;
+  int32_t len = (idx->text.length > 0) ? idx->lcp[best] : 0;
+  String repeat = {
+    .str = idx->text.str + pos,
+    .length = len,
+    .capacity = len,
+    .offset = 0,
+    .mutable = false,
+  };
+  return_ok(suffix_err, repeat);
+}
+
+// Saves the index and its text to `filename` in a layout that suffix_map() can use directly.
+// Returns OK on success, HALT if the file can't be written.
+int8_t suffix_save(const SuffixIndex* idx, const char* filename) {
+  FILE* fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return_halt(suffix_err, HALT, "failed to open file");
+  }
+  uint64_t n = idx->text.length;
+  _SuffixHeader header = { .length = n };
+  memcpy(header.magic, _SUFFIX_MAGIC, sizeof(header.magic));
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+    && fwrite(idx->sa, sizeof(int32_t), n, fp) == n
+    && fwrite(idx->lcp, sizeof(int32_t), n, fp) == n
+    && fwrite(idx->text.str, 1, n, fp) == n;
+  if (fclose(fp) != 0) ok = false;
+  if (!ok) {
+    return_halt(suffix_err, HALT, "couldn't finish writing to file");
+  }
+  return_ok(suffix_err, OK);
+}
+
+// Maps an index saved by suffix_save() back into memory, read-only, text included.
+// Nothing is parsed or copied; pages are loaded as queries touch them.
+// Returns SUFFIX_EMPTY on failure.
+SuffixIndex suffix_map(const char* filename) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "failed to open file");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(_SuffixHeader)) {
+    close(fd);
+    return_bad(suffix_err, SUFFIX_EMPTY, "file is too small to be a SuffixIndex");
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return_halt(suffix_err, SUFFIX_EMPTY, "mmap() failed");
+  }
+
+  const _SuffixHeader* header = map;
+  uint64_t n = header->length;
+  if (memcmp(header->magic, _SUFFIX_MAGIC, sizeof(header->magic)) != 0
+      || n > INT32_MAX
+      || sizeof(_SuffixHeader) + n * (2 * sizeof(int32_t) + 1) != (uint64_t)st.st_size) {
+    munmap(map, st.st_size);
+    return_bad(suffix_err, SUFFIX_EMPTY, "file is not a valid SuffixIndex");
+  }
+  char* base = (char*)map + sizeof(_SuffixHeader);
+  SuffixIndex idx = {
+    .text = {
+      .str = base + 2 * sizeof(int32_t) * n,
+      .length = n,
+      .capacity = n,
+      .offset = 0,
+      .mutable = false,
+    },
+    .sa = (int32_t*)base,
+    .lcp = (int32_t*)(base + sizeof(int32_t) * n),
+    .map = map,
+    .map_length = st.st_size,
+  };
+  return_ok(suffix_err, idx);
+}
+
+// Unmaps a mapped index and resets it to SUFFIX_EMPTY.
+// A built index lives in its arena; this only resets it.
+void suffix_free(SuffixIndex* idx) {
+  if (idx->map != NULL) munmap(idx->map, idx->map_length);
+  *idx = SUFFIX_EMPTY;
+}
+
+// shorthands of the queries using String keys.
+#define ssuffix_exists(idx_ptr, key_str) suffix_exists(idx_ptr, (key_str)->str, (key_str)->length)
+#define ssuffix_count(idx_ptr, key_str) suffix_count(idx_ptr, (key_str)->str, (key_str)->length)
+#define ssuffix_positions(idx_ptr, key_str, positions, max) \
+  suffix_positions(idx_ptr, (key_str)->str, (key_str)->length, positions, max)
@@ -0,0 +1,229 @@
+/*
+ * Tracing spans.
+ *
+ * Records how long scopes take, per thread, and dumps them as a
+ * Chrome/Perfetto trace (open the file in chrome://tracing or
+ * https://ui.perfetto.dev).
+ *
+ * Tracing is compiled out unless TRACE_ENABLE is defined. Then every
+ * macro below expands to nothing and trace_dump() only reports BAD,
+ * so instrumented code costs nothing.
+ *
+ * Usage:
+ *   void parse(String* s) {
+ *     TRACE_FUNC();              // span named after the function
+ *     ...
+ *     {
+ *       TRACE_SCOPE("tokenize"); // span until the end of this block
+ *       ...
+ *     }
+ *   }
+ *   ...
+ *   trace_dump("trace.json");
+ *
+ * Span names are stored as pointers: pass string literals or __func__.
+ *
+ * Every thread writes into its own ring buffer of TRACE_RING_SIZE spans,
+ * without locks. When it is full the oldest spans are overwritten. The
+ * buffers outlive their threads so that trace_dump() still sees them;
+ * call it once the traced threads are done, spans recorded while it
+ * runs may be missed.
+ *
+ * Timestamps come from rdtsc on x86 (converted using clock_gettime()
+ * at dump time) and from clock_gettime(CLOCK_MONOTONIC) elsewhere or
+ * with -DTRACE_NO_RDTSC.
+ *
+ * Defining TRACE_LIBS as well instruments the hot functions of
+ * strings.c, arena.c and utils.c through TRACE_LIB_FUNC().
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "err.c"
+_Thread_local signed char trace_err[ERR_BUF_SIZE];
+
+#ifdef TRACE_ENABLE
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(TRACE_NO_RDTSC)
+#include <x86intrin.h>
+#define _TRACE_RDTSC
+#endif
+
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE (1 << 14) // spans kept per thread. must be a power of two.
+#endif
+
+typedef struct {
+  const char* name;
+  uint64_t start; // ticks
+  uint64_t end;   // ticks
+} _TraceEvent;
+
+typedef struct _TraceBuffer {
+  uint64_t head; // spans written so far. only the owner thread writes it.
+  int tid;
+  struct _TraceBuffer* next; // every buffer ever registered, newest first.
+  _TraceEvent events[TRACE_RING_SIZE];
+} _TraceBuffer;
+
+typedef struct {
+  const char* name;
+  uint64_t start;
+} _TraceSpan;
+
+static _TraceBuffer* _trace_buffers = NULL;
+static _Thread_local _TraceBuffer* _trace_local = NULL;
+// first clock reading of the process. 0: unset, 1: being set, 2: set.
+static int _trace_epoch_state = 0;
+static uint64_t _trace_epoch_ticks, _trace_epoch_ns;
+
+static inline uint64_t _trace_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t _trace_ticks(void) {
+#ifdef _TRACE_RDTSC
+  return __rdtsc();
+#else
+  return _trace_ns();
+#endif
+}
+
+static void _trace_set_epoch(void) {
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&_trace_epoch_state, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    _trace_epoch_ticks = _trace_ticks();
+    _trace_epoch_ns = _trace_ns();
+    __atomic_store_n(&_trace_epoch_state, 2, __ATOMIC_RELEASE);
+  }
+  while (__atomic_load_n(&_trace_epoch_state, __ATOMIC_ACQUIRE) != 2);
+}
+
+// Returns the ring buffer of the calling thread, registering it on first use.
+// Returns NULL if it could not be allocated; spans of this thread are dropped then.
+static _TraceBuffer* _trace_buffer(void) {
+  if (_trace_local != NULL) return _trace_local;
+  _trace_set_epoch();
+  _TraceBuffer* buf = malloc(sizeof(_TraceBuffer));
+  if (buf == NULL) return NULL;
+  buf->head = 0;
+  buf->tid = gettid();
+  buf->next = __atomic_load_n(&_trace_buffers, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&_trace_buffers, &buf->next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  _trace_local = buf;
+  return buf;
+}
+
+static inline _TraceSpan _trace_begin(const char* name) {
+  _trace_buffer();
+  return (_TraceSpan) { .name = name, .start = _trace_ticks() };
+}
+
+// cleanup handler of the span variable declared by TRACE_SCOPE().
+static inline void _trace_end(_TraceSpan* span) {
+  uint64_t end = _trace_ticks();
+  _TraceBuffer* buf = _trace_local;
+  if (buf == NULL) return;
+  _TraceEvent* event = &buf->events[buf->head & (TRACE_RING_SIZE - 1)];
+  event->name = span->name;
+  event->start = span->start;
+  event->end = end;
+  __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE);
+}
+
+#define _TRACE_CAT_(a, b) a##b
+#define _TRACE_CAT(a, b) _TRACE_CAT_(a, b)
+
+// Records a span named `name` from here to the end of the enclosing block.
+#define TRACE_SCOPE(name) \
+  _TraceSpan _TRACE_CAT(_trace_span_, __LINE__) __attribute__((cleanup(_trace_end))) = _trace_begin(name)
+
+// Records a span named after the enclosing function, up to its return.
+#define TRACE_FUNC() TRACE_SCOPE(__func__)
+
+// Writes `name` as the body of a JSON string.
+static void _trace_write_name(FILE* fp, const char* name) {
+  for (const char* c = name; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') fprintf(fp, "\\%c", *c);
+    else if ((unsigned char)*c < 0x20) fprintf(fp, "\\u%04x", *c);
+    else fputc(*c, fp);
+  }
+}
+
+// Writes the spans of every thread to `filename` in the Chrome trace event format.
+// Returns OK on success, BAD if the file can't be written.
+int8_t trace_dump(const char* filename) {
+  FILE* fp = fopen(filename, "w");
+  if (fp == NULL) {
+    return_bad(trace_err, BAD, "failed to open file");
+  }
+  _trace_set_epoch();
+  // ticks per microsecond. rdtsc needs some elapsed time to be measured against.
+  double ticks_per_us = 1000.0;
+#ifdef _TRACE_RDTSC
+  uint64_t ns = _trace_ns() - _trace_epoch_ns;
+  if (ns < 10000000) {
+    struct timespec wait = { 0, 10000000 - ns };
+    nanosleep(&wait, NULL);
+  }
+  ns = _trace_ns() - _trace_epoch_ns;
+  ticks_per_us = (double)(_trace_ticks() - _trace_epoch_ticks) * 1000.0 / ns;
+#endif
+
+  int pid = getpid();
+  bool first = true;
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (_TraceBuffer* buf = __atomic_load_n(&_trace_buffers, __ATOMIC_ACQUIRE); buf != NULL; buf = buf->next) {
+    fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",", pid, buf->tid, buf->tid);
+    first = false;
+    uint64_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    uint64_t i = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+    for (; i < head; i++) {
+      const _TraceEvent* event = &buf->events[i & (TRACE_RING_SIZE - 1)];
+      fprintf(fp, ",\n{\"name\":\"");
+      _trace_write_name(fp, event->name);
+      fprintf(fp, "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+              (double)(int64_t)(event->start - _trace_epoch_ticks) / ticks_per_us,
+              (double)(event->end - event->start) / ticks_per_us, pid, buf->tid);
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  if (ferror(fp)) {
+    fclose(fp);
+    return_bad(trace_err, BAD, "couldn't finish writing to file");
+  }
+  if (fclose(fp) != 0) {
+    return_bad(trace_err, BAD, "couldn't finish writing to file");
+  }
+  return_ok(trace_err, OK);
+}
+
+#else // tracing compiled out
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNC() ((void)0)
+
+static inline int8_t trace_dump(const char* filename) {
+  (void)filename;
+  return_bad(trace_err, BAD, "tracing is disabled. build with -DTRACE_ENABLE");
+}
+
+#endif // TRACE_ENABLE
+
+// Span of a library function. Only recorded when built with -DTRACE_ENABLE -DTRACE_LIBS.
+#ifdef TRACE_LIBS
+#define TRACE_LIB_FUNC() TRACE_FUNC()
+#else
+#define TRACE_LIB_FUNC() ((void)0)
+#endif
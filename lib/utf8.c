@@ -0,0 +1,293 @@
+/*
+ * UTF-8 helpers for the String type.
+ *
+ * String stores raw bytes, so every operation in strings.c works on byte
+ * positions. This library adds validation and codepoint aware indexing on
+ * top of it without changing the String type itself.
+ *
+ * All the functions have an ASCII fast path: blocks of 16 (SSE2) or 8
+ * (portable) bytes that contain no byte >= 0x80 are skipped at once. When
+ * compiled with SSSE3 (-mssse3, -march=native, ...) validation of non-ASCII
+ * blocks uses the lookup table algorithm of Keiser & Lemire ("Validating
+ * UTF-8 In Less Than One Instruction Per Byte", 2021), which checks 16 bytes
+ * per iteration with three table lookups. Define UTF8_NO_SIMD to force the
+ * portable implementation.
+ *
+ * Date: October-19-2026
+ *
+ * ## HOW TO USE ##
+ * int8_t utf8_validate(const String* s)
+ *   -- Returns OK if `s` is well formed UTF-8, BAD otherwise.
+ *
+ * int64_t utf8_length(const String* s)
+ *   -- Returns the number of codepoints in `s`. `s` is expected to be valid.
+ *
+ * int64_t utf8_offset(const String* s, uint64_t index)
+ *   -- Returns the byte offset of the codepoint at `index`. `index` equal to
+ *      the codepoint length maps to s->length. BAD if out of range.
+ *
+ * String utf8_slice(const String* s, uint64_t start, uint64_t end)
+ *   -- Same as str_slice(), but `start` and `end` are codepoint indices,
+ *      so a multi-byte sequence is never cut in half.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "strings.c"
+
+#if defined(__SSE2__) && !defined(UTF8_NO_SIMD)
+#define _UTF8_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) && !defined(UTF8_NO_SIMD)
+#define _UTF8_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#include "err.c"
+_Thread_local signed char utf8_err[ERR_BUF_SIZE];
+
+#define _UTF8_ASCII_MASK 0x8080808080808080ULL
+
+// true for the 10xxxxxx continuation bytes.
+static inline bool _utf8_is_cont(char ch) { return ((uint8_t)ch & 0xC0) == 0x80; }
+
+#ifndef _UTF8_SSSE3
+// Validates `len` bytes one sequence at a time (Unicode 15, table 3-7).
+// Runs of ASCII are skipped 8 bytes at a time.
+static bool _utf8_validate_scalar(const uint8_t* str, uint64_t len) {
+  uint64_t i = 0;
+  while (i < len) {
+    if (i + 8 <= len) {
+      uint64_t word;
+      memcpy(&word, str + i, sizeof(word));
+      if ((word & _UTF8_ASCII_MASK) == 0) {
+        i += 8;
+        continue;
+      }
+    }
+    uint8_t b = str[i];
+    if (b < 0x80) {
+      i++;
+      continue;
+    }
+    uint8_t lo = 0x80, hi = 0xBF; // allowed range of the second byte
+    int conts; // number of continuation bytes after the lead
+    if (b < 0xC2) {
+      return false; // stray continuation or overlong 2 byte form
+    } else if (b < 0xE0) {
+      conts = 1;
+    } else if (b < 0xF0) {
+      conts = 2;
+      if (b == 0xE0) lo = 0xA0; // overlong
+      if (b == 0xED) hi = 0x9F; // surrogates
+    } else if (b < 0xF5) {
+      conts = 3;
+      if (b == 0xF0) lo = 0x90; // overlong
+      if (b == 0xF4) hi = 0x8F; // > U+10FFFF
+    } else {
+      return false;
+    }
+    if (i + conts >= len) return false;
+    if (str[i + 1] < lo || str[i + 1] > hi) return false;
+    for (int j = 2; j <= conts; j++) {
+      if (!_utf8_is_cont(str[i + j])) return false;
+    }
+    i += conts + 1;
+  }
+  return true;
+}
+#endif
+
+#ifdef _UTF8_SSSE3
+// error classes of the lookup tables. a byte pair is invalid if the three
+// lookups below share a bit.
+#define _UTF8_TOO_SHORT  (1 << 0) // lead byte followed by a lead or ASCII
+#define _UTF8_TOO_LONG   (1 << 1) // ASCII followed by a continuation
+#define _UTF8_OVERLONG_3 (1 << 2)
+#define _UTF8_TOO_LARGE  (1 << 3)
+#define _UTF8_SURROGATE  (1 << 4)
+#define _UTF8_OVERLONG_2 (1 << 5)
+#define _UTF8_TOO_LARGE_1000 (1 << 6)
+#define _UTF8_OVERLONG_4 (1 << 6)
+#define _UTF8_TWO_CONTS  (1 << 7) // two continuations, valid only inside 3/4 byte sequences
+#define _UTF8_CARRY (_UTF8_TOO_SHORT | _UTF8_TOO_LONG | _UTF8_TWO_CONTS)
+
+// checks every byte pair (and the 3/4 byte sequence lengths) of `input`.
+// `prev` is the previous block, needed for sequences crossing the boundary.
+static inline __m128i _utf8_check_block(__m128i input, __m128i prev) {
+  const __m128i byte_1_high_tbl = _mm_setr_epi8(
+    _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG,
+    _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG, _UTF8_TOO_LONG,
+    _UTF8_TWO_CONTS, _UTF8_TWO_CONTS, _UTF8_TWO_CONTS, _UTF8_TWO_CONTS,
+    _UTF8_TOO_SHORT | _UTF8_OVERLONG_2,
+    _UTF8_TOO_SHORT,
+    _UTF8_TOO_SHORT | _UTF8_OVERLONG_3 | _UTF8_SURROGATE,
+    _UTF8_TOO_SHORT | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000 | _UTF8_OVERLONG_4);
+  const __m128i byte_1_low_tbl = _mm_setr_epi8(
+    _UTF8_CARRY | _UTF8_OVERLONG_3 | _UTF8_OVERLONG_2 | _UTF8_OVERLONG_4,
+    _UTF8_CARRY | _UTF8_OVERLONG_2,
+    _UTF8_CARRY,
+    _UTF8_CARRY,
+    _UTF8_CARRY | _UTF8_TOO_LARGE,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000 | _UTF8_SURROGATE,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000,
+    _UTF8_CARRY | _UTF8_TOO_LARGE | _UTF8_TOO_LARGE_1000);
+  const __m128i byte_2_high_tbl = _mm_setr_epi8(
+    _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT,
+    _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT,
+    _UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_OVERLONG_3 | _UTF8_TOO_LARGE_1000 | _UTF8_OVERLONG_4,
+    _UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_OVERLONG_3 | _UTF8_TOO_LARGE,
+    _UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_SURROGATE | _UTF8_TOO_LARGE,
+    _UTF8_TOO_LONG | _UTF8_OVERLONG_2 | _UTF8_TWO_CONTS | _UTF8_SURROGATE | _UTF8_TOO_LARGE,
+    _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT, _UTF8_TOO_SHORT);
+  const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+  __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+  __m128i byte_1_high = _mm_shuffle_epi8(byte_1_high_tbl, _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibble));
+  __m128i byte_1_low = _mm_shuffle_epi8(byte_1_low_tbl, _mm_and_si128(prev1, low_nibble));
+  __m128i byte_2_high = _mm_shuffle_epi8(byte_2_high_tbl, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibble));
+  __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+  // the third and fourth byte of a sequence must be continuations, and
+  // those are exactly the TWO_CONTS cases. they cancel each other out.
+  __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+  __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+  __m128i is_third = _mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80));
+  __m128i is_fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80));
+  __m128i must23_80 = _mm_and_si128(_mm_or_si128(is_third, is_fourth), _mm_set1_epi8((char)0x80));
+  return _mm_xor_si128(must23_80, special_cases);
+}
+
+// non-zero if the last bytes of `input` start a sequence that continues in the next block.
+static inline __m128i _utf8_incomplete(__m128i input) {
+  const __m128i max_value = _mm_setr_epi8(
+    (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+    (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF, (char)0xFF,
+    (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+  return _mm_subs_epu8(input, max_value);
+}
+
+static bool _utf8_validate_simd(const uint8_t* str, uint64_t len) {
+  __m128i error = _mm_setzero_si128();
+  __m128i prev = _mm_setzero_si128();
+  __m128i prev_incomplete = _mm_setzero_si128();
+  uint64_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i input = _mm_loadu_si128((const __m128i*)(str + i));
+    if (_mm_movemask_epi8(input) == 0) { // ASCII block, only the previous one can be wrong
+      error = _mm_or_si128(error, prev_incomplete);
+      prev_incomplete = _mm_setzero_si128();
+    } else {
+      error = _mm_or_si128(error, _utf8_check_block(input, prev));
+      prev_incomplete = _utf8_incomplete(input);
+    }
+    prev = input;
+  }
+  if (i < len) { // zero padded tail. zeros behave as ASCII.
+    uint8_t tail[16] = {0};
+    memcpy(tail, str + i, len - i);
+    __m128i input = _mm_loadu_si128((const __m128i*)tail);
+    error = _mm_or_si128(error, _utf8_check_block(input, prev));
+    prev_incomplete = _utf8_incomplete(input);
+  }
+  error = _mm_or_si128(error, prev_incomplete);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+
+// Returns OK if `s` is well formed UTF-8 (no overlongs, surrogates or
+// codepoints above U+10FFFF), BAD otherwise.
+int8_t utf8_validate(const String* s) {
+#ifdef _UTF8_SSSE3
+  bool valid = _utf8_validate_simd((const uint8_t*)s->str, s->length);
+#else
+  bool valid = _utf8_validate_scalar((const uint8_t*)s->str, s->length);
+#endif
+  if (!valid) return_bad(utf8_err, BAD, "invalid UTF-8 sequence");
+  return_ok(utf8_err, OK);
+}
+
+// number of codepoint starts (non continuation bytes) in a block.
+#ifdef _UTF8_SSE2
+#define _UTF8_BLOCK 16
+static inline int _utf8_block_starts(const char* str) {
+  __m128i input = _mm_loadu_si128((const __m128i*)str);
+  // continuation bytes are -128..-65 as signed chars.
+  return __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(input, _mm_set1_epi8(-65))));
+}
+#else
+#define _UTF8_BLOCK 8
+static inline int _utf8_block_starts(const char* str) {
+  uint64_t word;
+  memcpy(&word, str, sizeof(word));
+  if ((word & _UTF8_ASCII_MASK) == 0) return 8;
+  // bit 7 set and bit 6 clear marks a continuation byte.
+  uint64_t conts = word & ~(word << 1) & _UTF8_ASCII_MASK;
+  return 8 - __builtin_popcountll(conts);
+}
+#endif
+
+// Returns the byte offset of the `index`th codepoint from `str`, `len` if
+// `index` is exactly the number of codepoints, or -1 if it is out of range.
+static int64_t _utf8_advance(const char* str, uint64_t len, uint64_t index) {
+  uint64_t i = 0, seen = 0;
+  for (; i + _UTF8_BLOCK <= len; i += _UTF8_BLOCK) {
+    int starts = _utf8_block_starts(str + i);
+    if (seen + starts > index) break;
+    seen += starts;
+  }
+  for (; i < len; i++) {
+    if (_utf8_is_cont(str[i])) continue;
+    if (seen == index) return i;
+    seen++;
+  }
+  return (seen == index) ? (int64_t)len : -1;
+}
+
+// Returns the number of codepoints in `s`. Assumes `s` is valid UTF-8,
+// call utf8_validate() once on ingest.
+int64_t utf8_length(const String* s) {
+  uint64_t count = 0, i = 0;
+  for (; i + _UTF8_BLOCK <= s->length; i += _UTF8_BLOCK) {
+    count += _utf8_block_starts(s->str + i);
+  }
+  for (; i < s->length; i++) {
+    if (!_utf8_is_cont(s->str[i])) count++;
+  }
+  return_ok(utf8_err, count);
+}
+
+// Returns the byte offset of the codepoint at `index`.
+// An `index` equal to the codepoint length maps to s->length.
+// Returns BAD if `index` is out of range.
+int64_t utf8_offset(const String* s, uint64_t index) {
+  int64_t offset = _utf8_advance(s->str, s->length, index);
+  if (offset < 0) return_bad(utf8_err, BAD, "codepoint index out of range");
+  return_ok(utf8_err, offset);
+}
+
+// Returns a non-owning, non-mutable view of the codepoints [start, end) of `s`.
+// Returns STR_EMPTY on invalid slice parameters.
+String utf8_slice(const String* s, uint64_t start, uint64_t end) {
+  if (start >= end) return_bad(utf8_err, STR_EMPTY, "incorrect slice length");
+  int64_t byte_start = _utf8_advance(s->str, s->length, start);
+  if (byte_start < 0) return_bad(utf8_err, STR_EMPTY, "slice start out of range");
+  int64_t byte_len = _utf8_advance(s->str + byte_start, s->length - byte_start, end - start);
+  if (byte_len < 0) return_bad(utf8_err, STR_EMPTY, "slice end out of range");
+  String slice = str_slice(s, byte_start, byte_start + byte_len);
+  if (slice.str == STR_EMPTY.str) return_bad(utf8_err, STR_EMPTY, "failed to slice s");
+  return_ok(utf8_err, slice);
+}
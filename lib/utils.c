@@ -1,7 +1,22 @@
 #pragma once
 
 #include "strings.c"
+#include "arena.c"
+#include "trace.c"
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifndef UTILS_NO_URING
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 #include "err.c"
 _Thread_local char utils_err[ERR_BUF_SIZE];
@@ -12,27 +27,41 @@ bool is_end_of_line(char ch) { return (ch == '\n' || ch == '\0'); }
 bool is_alpha(char ch) { return ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')); }
 
 String file_to_str(char* filename) {
+  TRACE_LIB_FUNC();
   if (access(filename, F_OK | R_OK) != 0) {
     return_halt(utils_err, STR_EMPTY, "file does not exist or not readable");
   }
   FILE* fp = fopen(filename, "r");
   if (fp == NULL) {
-    fclose(fp);
     return_halt(utils_err, STR_EMPTY, "failed to open file");
   }
-  String file = str_declare(STR_DYNAMIC);
-  int ch;
-  while ((ch = fgetc(fp)) != EOF)
-    err_expect(str_err, str_insert(&file, STR_END, ch));
-
+  struct stat st;
+  if (fstat(fileno(fp), &st) != 0) {
+    fclose(fp);
+    return_halt(utils_err, STR_EMPTY, "failed to stat file");
+  }
+  // read the whole file in one go. the extra byte lets fread() hit EOF
+  // without growing; files that grow while being read continue in chunks.
+  String file = str_declare(st.st_size + 1);
+  if (file.str == STR_EMPTY.str) {
+    fclose(fp);
+    return_halt(utils_err, STR_EMPTY, "failed to allocate memory for file");
+  }
+  size_t n;
+  while ((n = fread(file.str + file.length, sizeof(char), file.capacity - file.length, fp)) > 0) {
+    file.length += n;
+    if (file.length == file.capacity) {
+      err_expect(str_err, str_reserve(&file, file.capacity * STR_GROWTH_NUM / STR_GROWTH_DEN));
+    }
+  }
   fclose(fp);
   return_ok(utils_err, file);
 }
 
 int8_t str_to_file(char* filename, String content) {
+  TRACE_LIB_FUNC();
   FILE* fp = fopen(filename, "w");
   if (fp == NULL) {
-    fclose(fp);
     return_halt(utils_err, HALT, "failed to open file");
   }
   size_t bytes_written = fwrite(content.str, sizeof(char), content.length, fp);
@@ -43,3 +72,451 @@ int8_t str_to_file(char* filename, String content) {
   fclose(fp);
   return_ok(utils_err, OK);
 }
+
+/*
+ * Batched file loading.
+ *
+ * files_to_strs() loads many files at once into arena-backed Strings.
+ * On linux it submits openat/statx for the whole batch through io_uring,
+ * allocates every buffer from the arena, then submits all the reads and
+ * closes. If io_uring is not available (old kernel, seccomp, or built with
+ * -DUTILS_NO_URING) it falls back to a small thread pool doing the same
+ * steps with open/fstat/pread. If the ring breaks down halfway, the files it
+ * didn't finish are handed to the thread pool.
+ *
+ * The loaded Strings are immutable views into the arena: never call
+ * str_free() on them, free the arena instead.
+ */
+
+#ifndef FILES_RING_ENTRIES
+#define FILES_RING_ENTRIES 256 // submission queue size. two entries per file in flight.
+#endif
+#ifndef FILES_THREADS
+#define FILES_THREADS 8 // worker count of the fallback thread pool.
+#endif
+
+typedef struct {
+  String content; // arena-backed, immutable. never call str_free() on it.
+  int8_t status;  // OK, or BAD if this file could not be loaded.
+  int err;        // errno of the failed step. 0 on success.
+} FileLoad;
+
+static void _file_load_fail(FileLoad* load, int err) {
+  load->status = BAD;
+  load->err = err;
+  load->content = STR_EMPTY;
+}
+
+// Carves a buffer for every successfully opened file out of the arena.
+// The size is expected in content.length. Files that already have a buffer
+// keep it. Not thread safe, just like the arena.
+static void _files_alloc(Arena* arena, FileLoad* loads, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) {
+    if (loads[i].status != OK || loads[i].content.str != NULL) continue;
+    uint64_t size = loads[i].content.length;
+    char* buf = arena_alloc(arena, size);
+    if (buf == NULL) {
+      _file_load_fail(&loads[i], EFBIG);
+      continue;
+    }
+    loads[i].content = (String) {
+      .str = buf,
+      .capacity = size,
+      .length = 0,
+      .offset = 0,
+      .mutable = false,
+    };
+  }
+}
+
+#ifndef UTILS_NO_URING
+// minimal io_uring instance, mapped by hand so that no liburing is needed.
+typedef struct {
+  int fd;
+  uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+  uint32_t *cq_head, *cq_tail, *cq_mask;
+  uint32_t sq_local_tail; // tail of the prepared but not yet published entries.
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_len, cq_ring_len, sqes_len;
+} _Uring;
+
+static void _uring_free(_Uring* r) {
+  if (r->sqes != NULL) munmap(r->sqes, r->sqes_len);
+  if (r->cq_ring != NULL && r->cq_ring != r->sq_ring) munmap(r->cq_ring, r->cq_ring_len);
+  if (r->sq_ring != NULL) munmap(r->sq_ring, r->sq_ring_len);
+  close(r->fd);
+}
+
+// checks whether the kernel knows every opcode the loader needs.
+static bool _uring_supports_ops(int fd) {
+  uint32_t n_ops = 256;
+  struct io_uring_probe* probe = calloc(1, sizeof(struct io_uring_probe) + n_ops * sizeof(struct io_uring_probe_op));
+  if (probe == NULL) return false;
+  bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, n_ops) == 0;
+  uint8_t ops[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+  for (size_t i = 0; supported && i < sizeof(ops); i++) {
+    supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+  }
+  free(probe);
+  return supported;
+}
+
+// Returns 0 on success, -1 if io_uring can't be used.
+static int _uring_init(_Uring* r, uint32_t entries) {
+  *r = (_Uring) { .fd = -1 };
+  struct io_uring_params p = {0};
+  r->fd = syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0) return -1;
+  if (!_uring_supports_ops(r->fd)) {
+    close(r->fd);
+    return -1;
+  }
+
+  r->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  r->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (r->cq_ring_len > r->sq_ring_len) r->sq_ring_len = r->cq_ring_len;
+    r->cq_ring_len = r->sq_ring_len;
+  }
+  r->sq_ring = mmap(NULL, r->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_ring == MAP_FAILED) {
+    r->sq_ring = NULL;
+    _uring_free(r);
+    return -1;
+  }
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    r->cq_ring = r->sq_ring;
+  } else {
+    r->cq_ring = mmap(NULL, r->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ring == MAP_FAILED) {
+      r->cq_ring = NULL;
+      _uring_free(r);
+      return -1;
+    }
+  }
+  r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    r->sqes = NULL;
+    _uring_free(r);
+    return -1;
+  }
+
+  uint8_t* sq = r->sq_ring;
+  uint8_t* cq = r->cq_ring;
+  r->sq_head = (uint32_t*)(sq + p.sq_off.head);
+  r->sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+  r->sq_mask = (uint32_t*)(sq + p.sq_off.ring_mask);
+  r->sq_array = (uint32_t*)(sq + p.sq_off.array);
+  r->cq_head = (uint32_t*)(cq + p.cq_off.head);
+  r->cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+  r->cq_mask = (uint32_t*)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  r->sq_local_tail = *r->sq_tail;
+  return 0;
+}
+
+// Returns a zeroed submission entry. It is published on the next _uring_complete().
+static struct io_uring_sqe* _uring_sqe(_Uring* r, uint8_t opcode, int fd, uint64_t user_data) {
+  uint32_t idx = r->sq_local_tail++ & *r->sq_mask;
+  struct io_uring_sqe* sqe = &r->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = user_data;
+  r->sq_array[idx] = idx;
+  return sqe;
+}
+
+// Submits every prepared entry and collects `want` completions into `out`.
+// *got counts the completions collected, also when the ring fails halfway.
+// Returns 0 on success, -errno if the ring failed.
+static int _uring_complete(_Uring* r, struct io_uring_cqe* out, uint32_t want, uint32_t* got) {
+  uint32_t to_submit = r->sq_local_tail - *r->sq_tail;
+  __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+  *got = 0;
+  while (*got < want) {
+    long ret = syscall(__NR_io_uring_enter, r->fd, to_submit, want - *got, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      return -errno;
+    }
+    to_submit -= ret;
+    uint32_t head = *r->cq_head;
+    uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && *got < want) {
+      out[(*got)++] = r->cqes[head & *r->cq_mask];
+      head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return 0;
+}
+
+// After _uring_complete() failed with `missing` completions not collected,
+// waits (best effort) for the entries the kernel did take from the submission
+// queue, so that no opened fd or running read is left behind. Entries it never
+// took are dropped. `taken` tells, per index in user_data, whether the kernel
+// took the entry. Returns the number of completions added to `out`.
+static uint32_t _uring_settle(_Uring* r, struct io_uring_cqe* out, uint32_t missing, bool* taken) {
+  uint32_t sq_head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  uint32_t untaken = r->sq_local_tail - sq_head;
+  for (uint32_t pos = sq_head; pos != r->sq_local_tail; pos++) {
+    taken[r->sqes[r->sq_array[pos & *r->sq_mask]].user_data] = false;
+  }
+  r->sq_local_tail = sq_head;
+  __atomic_store_n(r->sq_tail, sq_head, __ATOMIC_RELEASE);
+
+  uint32_t want = missing - untaken, got = 0;
+  for (int tries = 0; got < want && tries < 100; tries++) {
+    uint32_t head = *r->cq_head;
+    uint32_t tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && got < want) {
+      out[got++] = r->cqes[head & *r->cq_mask];
+      head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    if (got < want && syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+      struct timespec wait = { 0, 1000000 };
+      nanosleep(&wait, NULL);
+    }
+  }
+  return got;
+}
+
+static int8_t _files_load_pool(Arena* arena, char** filenames, const uint64_t* indices, uint64_t count, FileLoad* loads);
+
+// loads `count` files through io_uring, FILES_RING_ENTRIES / 2 files at a time.
+// Returns OK once every file has a status, BAD if the ring can't be used at all.
+static int8_t _files_load_uring(Arena* arena, char** filenames, uint64_t count, FileLoad* loads) {
+  _Uring ring;
+  if (_uring_init(&ring, FILES_RING_ENTRIES) != 0) return BAD;
+
+  const uint32_t batch = FILES_RING_ENTRIES / 2;
+  struct statx* stx = malloc(sizeof(struct statx) * batch);
+  struct io_uring_cqe* cqes = malloc(sizeof(struct io_uring_cqe) * FILES_RING_ENTRIES);
+  int* fds = malloc(sizeof(int) * batch);
+  bool* taken = malloc(sizeof(bool) * FILES_RING_ENTRIES);
+  if (stx == NULL || cqes == NULL || fds == NULL || taken == NULL) {
+    free(stx), free(cqes), free(fds), free(taken);
+    _uring_free(&ring);
+    return BAD;
+  }
+
+  uint64_t base;
+  uint32_t n = 0, got = 0;
+  enum { _FILES_OPEN, _FILES_READ, _FILES_CLOSE } phase = _FILES_OPEN; // step of the batch in flight
+  for (base = 0; base < count; base += batch) {
+    n = (count - base < batch) ? count - base : batch;
+    FileLoad* batch_loads = loads + base;
+
+    // open + statx. user_data holds the index, low bit tells which one completed.
+    phase = _FILES_OPEN;
+    for (uint32_t i = 0; i < n; i++) {
+      struct io_uring_sqe* sqe = _uring_sqe(&ring, IORING_OP_OPENAT, AT_FDCWD, (uint64_t)i << 1);
+      sqe->addr = (uint64_t)(uintptr_t)filenames[base + i];
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe = _uring_sqe(&ring, IORING_OP_STATX, AT_FDCWD, ((uint64_t)i << 1) | 1);
+      sqe->addr = (uint64_t)(uintptr_t)filenames[base + i];
+      sqe->len = STATX_SIZE;
+      sqe->off = (uint64_t)(uintptr_t)&stx[i];
+      fds[i] = -1;
+    }
+    bool failed = _uring_complete(&ring, cqes, n * 2, &got) != 0;
+    if (failed) got += _uring_settle(&ring, cqes + got, n * 2 - got, taken);
+    for (uint32_t c = 0; c < got; c++) {
+      uint32_t i = cqes[c].user_data >> 1;
+      if (cqes[c].res < 0) {
+        _file_load_fail(&batch_loads[i], -cqes[c].res);
+      } else if ((cqes[c].user_data & 1) == 0) {
+        fds[i] = cqes[c].res;
+      }
+    }
+    if (failed) goto ring_failure;
+    for (uint32_t i = 0; i < n; i++) {
+      if (batch_loads[i].status == OK) batch_loads[i].content.length = stx[i].stx_size;
+    }
+    _files_alloc(arena, batch_loads, n);
+
+    // read until every file is complete. short reads are simply resubmitted.
+    phase = _FILES_READ;
+    uint32_t pending;
+    do {
+      pending = 0;
+      for (uint32_t i = 0; i < n; i++) {
+        String* content = &batch_loads[i].content;
+        if (batch_loads[i].status != OK || content->length == content->capacity) continue;
+        struct io_uring_sqe* sqe = _uring_sqe(&ring, IORING_OP_READ, fds[i], i);
+        sqe->addr = (uint64_t)(uintptr_t)(content->str + content->length);
+        uint64_t left = content->capacity - content->length;
+        sqe->len = (left > INT32_MAX) ? INT32_MAX : left; // the result has to fit in cqe->res
+        sqe->off = content->length;
+        pending++;
+      }
+      failed = _uring_complete(&ring, cqes, pending, &got) != 0;
+      if (failed) got += _uring_settle(&ring, cqes + got, pending - got, taken);
+      for (uint32_t c = 0; c < got; c++) {
+        FileLoad* load = &batch_loads[cqes[c].user_data];
+        if (cqes[c].res < 0) {
+          _file_load_fail(load, -cqes[c].res);
+        } else if (cqes[c].res == 0) { // file shrunk since statx
+          load->content.capacity = load->content.length;
+        } else {
+          load->content.length += cqes[c].res;
+        }
+      }
+      if (failed) goto ring_failure;
+    } while (pending > 0);
+
+    phase = _FILES_CLOSE;
+    uint32_t opened = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      taken[i] = true;
+      if (fds[i] < 0) continue;
+      _uring_sqe(&ring, IORING_OP_CLOSE, fds[i], i);
+      opened++;
+    }
+    failed = _uring_complete(&ring, cqes, opened, &got) != 0;
+    if (failed) _uring_settle(&ring, cqes + got, opened - got, taken);
+    // every close the kernel took will happen, only the others are left to us.
+    for (uint32_t i = 0; i < n; i++) {
+      if (taken[i]) fds[i] = -1;
+    }
+    if (failed) goto ring_failure;
+  }
+
+  free(stx), free(cqes), free(fds), free(taken);
+  _uring_free(&ring);
+  return OK;
+
+ring_failure:
+  // the ring broke down in the middle of a batch. everything that isn't
+  // finished yet goes to the thread pool: the whole batch if it broke before
+  // the reads, else the files whose reads didn't complete (they keep their
+  // buffer and what was read), and every later batch.
+  for (uint32_t i = 0; i < n; i++) {
+    if (fds[i] >= 0) close(fds[i]);
+  }
+  free(stx), free(cqes), free(fds), free(taken);
+  _uring_free(&ring);
+  uint64_t* unfinished = malloc(sizeof(uint64_t) * (count - base));
+  uint64_t n_unfinished = 0;
+  for (uint64_t i = base; i < count; i++) {
+    FileLoad* load = &loads[i];
+    if (load->status != OK) continue;
+    if (i >= base + n || phase == _FILES_OPEN || (phase == _FILES_READ && load->content.length != load->content.capacity)) {
+      if (unfinished != NULL) unfinished[n_unfinished++] = i;
+      else _file_load_fail(load, EIO);
+    }
+  }
+  if (unfinished != NULL && _files_load_pool(arena, filenames, unfinished, n_unfinished, loads) != OK) {
+    for (uint64_t k = 0; k < n_unfinished; k++) _file_load_fail(&loads[unfinished[k]], EIO);
+  }
+  free(unfinished);
+  return OK;
+}
+#endif
+
+// shared state of the fallback thread pool.
+typedef struct {
+  char** filenames;
+  FileLoad* loads;
+  const uint64_t* indices; // files to load, NULL for all of them
+  int* fds;                // one per file to load
+  uint64_t count;
+  uint64_t next; // next file to pick up. updated atomically.
+  int phase;     // 0: open + fstat, 1: pread + close.
+} _FilePool;
+
+static void* _files_pool_worker(void* arg) {
+  _FilePool* pool = arg;
+  uint64_t k;
+  while ((k = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count) {
+    uint64_t i = (pool->indices != NULL) ? pool->indices[k] : k;
+    FileLoad* load = &pool->loads[i];
+    if (pool->phase == 0) {
+      pool->fds[k] = open(pool->filenames[i], O_RDONLY | O_CLOEXEC);
+      if (pool->fds[k] < 0) {
+        _file_load_fail(load, errno);
+        continue;
+      }
+      if (load->content.str != NULL) continue; // partly read already, size known
+      struct stat st;
+      if (fstat(pool->fds[k], &st) != 0) {
+        _file_load_fail(load, errno);
+        continue;
+      }
+      load->content.length = st.st_size;
+    } else {
+      String* content = &load->content;
+      while (load->status == OK && content->length < content->capacity) {
+        ssize_t n = pread(pool->fds[k], content->str + content->length, content->capacity - content->length, content->length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) _file_load_fail(load, errno);
+        else if (n == 0) content->capacity = content->length; // file shrunk since fstat
+        else content->length += n;
+      }
+      if (pool->fds[k] >= 0) close(pool->fds[k]);
+    }
+  }
+  return NULL;
+}
+
+// runs one phase of the pool. if no thread can be spawned the caller does all the work.
+static void _files_pool_run(_FilePool* pool, int phase) {
+  pool->phase = phase;
+  pool->next = 0;
+  pthread_t threads[FILES_THREADS];
+  int spawned = 0;
+  uint64_t n_threads = (pool->count < FILES_THREADS) ? pool->count : FILES_THREADS;
+  while (spawned + 1 < (int)n_threads && pthread_create(&threads[spawned], NULL, _files_pool_worker, pool) == 0)
+    spawned++;
+  _files_pool_worker(pool);
+  for (int t = 0; t < spawned; t++) pthread_join(threads[t], NULL);
+}
+
+// loads the `count` files listed in `indices`, or the first `count` files if it is NULL.
+static int8_t _files_load_pool(Arena* arena, char** filenames, const uint64_t* indices, uint64_t count, FileLoad* loads) {
+  int* fds = malloc(sizeof(int) * count);
+  if (fds == NULL) return HALT;
+  for (uint64_t i = 0; i < count; i++) fds[i] = -1;
+
+  _FilePool pool = { .filenames = filenames, .loads = loads, .indices = indices, .fds = fds, .count = count };
+  _files_pool_run(&pool, 0);
+  for (uint64_t k = 0; k < count; k++) _files_alloc(arena, &loads[(indices != NULL) ? indices[k] : k], 1);
+  _files_pool_run(&pool, 1);
+  free(fds);
+  return OK;
+}
+
+// Loads every file in `filenames` into an arena-backed String.
+// The status of each file is written to `loads[i]` (status + errno), and a
+// file that failed never affects the others. Never call str_free() on the contents.
+// Returns OK if every file was loaded, BAD if some of them failed and HALT
+// if the loader couldn't run at all.
+int8_t files_to_strs(Arena* arena, char** filenames, uint64_t count, FileLoad* loads) {
+  TRACE_LIB_FUNC();
+  if (arena == NULL || filenames == NULL || loads == NULL)
+    return_halt(utils_err, HALT, "arena, filenames and loads must not be NULL");
+  for (uint64_t i = 0; i < count; i++) loads[i] = (FileLoad) { .status = OK };
+
+  int8_t ret = BAD;
+#ifndef UTILS_NO_URING
+  ret = _files_load_uring(arena, filenames, count, loads);
+#endif
+  if (ret != OK) ret = _files_load_pool(arena, filenames, NULL, count, loads);
+  if (ret != OK) return_halt(utils_err, HALT, "failed to allocate memory for the loader");
+
+  uint64_t failed = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    if (loads[i].status != OK) failed++;
+  }
+  if (failed > 0) {
+    char msg[ERR_BUF_SIZE / 2];
+    snprintf(msg, sizeof(msg), "%lu of %lu files failed to load", failed, count);
+    return_bad(utils_err, BAD, msg);
+  }
+  return_ok(utils_err, OK);
+}